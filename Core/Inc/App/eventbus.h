@@ -0,0 +1,36 @@
+/*
+ * eventbus.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: agent
+ */
+
+#ifndef INC_APP_EVENTBUS_H_
+#define INC_APP_EVENTBUS_H_
+
+#include "stdio.h"
+#include "stdint.h"
+#include "stdbool.h"
+
+// Pending work, one bit per source or module to wake
+#define EVENT_NETIF_RX			(1UL << 0)	// Byte received from the WIFI/4G module
+#define EVENT_MQTT				(1UL << 1)
+#define EVENT_STATUSREPORTER	(1UL << 2)
+#define EVENT_COMMAND			(1UL << 3)	// MQTT message received
+#define EVENT_BILLACCEPTOR		(1UL << 4)
+#define EVENT_LCD				(1UL << 5)
+#define EVENT_KEYPAD			(1UL << 6)	// Keypad scan period
+#define EVENT_KEYPADHANDLER		(1UL << 7)	// Key pressed or held
+#define EVENT_TCD				(1UL << 8)
+#define EVENT_STATE				(1UL << 9)
+#define EVENT_INPUT				(1UL << 10)	// Key pressed, a customer is in front of the machine
+#define EVENT_STATUS_CHANGED	(1UL << 11)	// Dispenser, bill acceptor or connection status changed
+#define EVENT_ALL				0xFFFFFFFF
+
+typedef uint32_t EVENTBUS_mask_t;
+
+void EVENTBUS_post(EVENTBUS_mask_t events);
+EVENTBUS_mask_t EVENTBUS_take();
+bool EVENTBUS_is_pending();
+
+#endif /* INC_APP_EVENTBUS_H_ */
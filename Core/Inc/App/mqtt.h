@@ -3,13 +3,19 @@
 
 #include "stdint.h"
 #include "stdbool.h"
+#include "App/msghandle.h"
 
 
 #define NETWORK_RESET_WAIT_TIME		10000	// 10000ms
 #define COMMAND_INTERVAL	1500		// 1500ms
+#define PUBLISH_INTERVAL	100			// 100ms between two publish commands
+#define PUBLISH_WINDOW		4			// Publishes waiting for their acknowledgement
+#define PUBLISH_ACK_TIMEOUT	10000		// 10000ms, the unacknowledged publishes are sent again
+#define MQTT_POLL_INTERVAL	100			// 100ms
 #define CLIENTID_MAX_LEN	64
 #define TOPIC_MAX_LEN       48
 #define PAYLOAD_MAX_LEN     256
+#define BATCH_SUBTOPIC		"rp/batch"	// Outbox reports sent together in one publish
 
 
 enum {
@@ -23,6 +29,7 @@ typedef struct {
     char payload[PAYLOAD_MAX_LEN];
     uint8_t qos;
     uint8_t retain;
+    uint8_t persistent;		// Kept in the flash outbox until published, survives a reset
 }MQTT_message_t;
 
 void MQTT_init();
@@ -30,8 +37,11 @@ void MQTT_run();
 
 
 bool MQTT_is_ready();
-bool MQTT_sent_message(MQTT_message_t * message);
-bool MQTT_receive_message(MQTT_message_t * message);
+uint32_t MQTT_get_retransmit_count();
+// Takes the slot from the caller, it is released once published
+bool MQTT_sent_message(MSGPOOL_handle_t handle);
+// The caller releases the handle when done with the message
+bool MQTT_receive_message(MSGPOOL_handle_t * handle);
 
 
 #endif //MQTT_H
@@ -0,0 +1,18 @@
+/*
+ * msghandle.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: agent
+ */
+
+#ifndef INC_APP_MSGHANDLE_H_
+#define INC_APP_MSGHANDLE_H_
+
+#include "stdint.h"
+
+// Slot of the message pool (App/msgpool.h), what the MQTT queues pass
+typedef uint8_t MSGPOOL_handle_t;
+
+#define MSGPOOL_NONE			0xFF
+
+#endif /* INC_APP_MSGHANDLE_H_ */
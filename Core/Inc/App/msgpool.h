@@ -0,0 +1,35 @@
+/*
+ * msgpool.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: agent
+ */
+
+#ifndef INC_APP_MSGPOOL_H_
+#define INC_APP_MSGPOOL_H_
+
+#include "stdio.h"
+#include "stdint.h"
+#include "stdbool.h"
+#include "App/msghandle.h"
+#include "App/mqtt.h"
+
+// MQTT messages are built in place in a slot of the pool, the queues pass the handle.
+// A slot has one owner at a time, it goes back to the pool when released
+#define MSGPOOL_SIZE			6		// Publish in progress, received command, queued reports
+#define MSGPOOL_RESERVED		1		// Left to MSGPOOL_alloc_reserved, a billing report is never refused
+
+typedef struct {
+	uint32_t used;				// Slots allocated now
+	uint32_t peak;				// Most slots allocated at once, since boot
+	uint32_t fail_count;		// Allocations refused because the pool was empty, since boot
+}MSGPOOL_stats_t;
+
+void MSGPOOL_init();
+MSGPOOL_handle_t MSGPOOL_alloc();
+MSGPOOL_handle_t MSGPOOL_alloc_reserved();
+MQTT_message_t * MSGPOOL_get(MSGPOOL_handle_t handle);
+void MSGPOOL_release(MSGPOOL_handle_t handle);
+void MSGPOOL_get_stats(MSGPOOL_stats_t * stats);
+
+#endif /* INC_APP_MSGPOOL_H_ */
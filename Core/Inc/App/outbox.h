@@ -0,0 +1,49 @@
+/*
+ * outbox.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: agent
+ */
+
+#ifndef INC_APP_OUTBOX_H_
+#define INC_APP_OUTBOX_H_
+
+#include "stdio.h"
+#include "stdint.h"
+#include "stdbool.h"
+#include "App/mqtt.h"
+
+/*
+ * Outbox region, internal flash after the current firmware and before the OTA flag page
+ */
+#define OUTBOX_ADDRESS			0x08038000			// 0x08038000 - 0x0803F7FF: 30KBytes
+#define OUTBOX_PAGES			15
+
+// Unsent message read in place in the flash, the strings are not terminated
+typedef struct {
+	const char * topic;
+	const char * payload;
+	uint8_t topic_len;
+	uint16_t payload_len;
+	uint8_t qos;
+	uint8_t retain;
+	uint8_t page;				// Position of the record, for OUTBOX_next
+	uint16_t offset;
+}OUTBOX_entry_t;
+
+typedef struct {
+	uint32_t depth;				// Messages waiting to be published
+	uint32_t oldest_age;		// Seconds since the oldest one was queued
+	uint32_t drop_count;		// Unsent messages erased to make room, since boot
+}OUTBOX_stats_t;
+
+bool OUTBOX_init();
+bool OUTBOX_push(MQTT_message_t * message);
+bool OUTBOX_find(uint32_t index, OUTBOX_entry_t * entry);
+bool OUTBOX_next(OUTBOX_entry_t * entry);
+void OUTBOX_pop();
+uint32_t OUTBOX_get_depth();
+uint32_t OUTBOX_get_drop_count();
+void OUTBOX_get_stats(OUTBOX_stats_t * stats);
+
+#endif /* INC_APP_OUTBOX_H_ */
@@ -0,0 +1,58 @@
+/*
+ * profiler.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: agent
+ */
+
+#ifndef INC_APP_PROFILER_H_
+#define INC_APP_PROFILER_H_
+
+#include "stdio.h"
+#include "stdbool.h"
+
+// Profiling costs a few cycles per call, it can be compiled out from the build flags
+#ifndef PROFILER_ENABLE
+#define PROFILER_ENABLE			1
+#endif
+#define PROFILER_TASK_MAX		16
+// Histogram buckets by execution time: <10us, <100us, <1ms, <10ms, <100ms, >=100ms
+#define PROFILER_HIST_SIZE		6
+
+enum {
+	PROFILER_MQTT,
+	PROFILER_STATUSREPORTER,
+	PROFILER_COMMANDHANDLER,
+	PROFILER_BILLACCEPTORMNG,
+	PROFILER_LCDMNG,
+	PROFILER_KEYPADMNG,
+	PROFILER_KEYPADHANDLER,
+	PROFILER_TCDMNG,
+	PROFILER_SCHEDULER,
+	PROFILER_STATE,
+	PROFILER_MODULE_MAX
+};
+
+typedef struct {
+	uint32_t count;
+	uint32_t min;			// In cycles
+	uint32_t max;			// In cycles
+	uint64_t total;			// In cycles
+	uint32_t hist[PROFILER_HIST_SIZE];
+}PROFILER_entry_t;
+
+#if PROFILER_ENABLE
+#define PROFILER_RUN(module, call)	do { uint32_t _start = PROFILER_start(); call; PROFILER_stop(module, _start); } while(0)
+#else
+#define PROFILER_RUN(module, call)	do { call; } while(0)
+#endif
+
+void PROFILER_init();
+uint32_t PROFILER_start();
+void PROFILER_stop(uint8_t module, uint32_t start);
+void PROFILER_loop();
+void PROFILER_reset();
+void PROFILER_dump();
+size_t PROFILER_build_metrics(char * buf, size_t buf_len);
+
+#endif /* INC_APP_PROFILER_H_ */
@@ -0,0 +1,81 @@
+/*
+ * reportcodec.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: agent
+ */
+
+#ifndef INC_APP_REPORTCODEC_H_
+#define INC_APP_REPORTCODEC_H_
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "stddef.h"
+
+// Binary reports: one byte with the version and the report, then the fields. A field is
+// a tag, its wire type in the 2 high bits and its id in the others, then its value.
+// Numbers are unsigned LEB128 varints. The frame goes out in base64, the network
+// module takes the payload as a string.
+// The decoder for the server side is in Tools/reportcodec
+#define REPORTCODEC_VERSION			1
+#define REPORTCODEC_FRAME_MAX_LEN	128
+
+// Wire types
+#define REPORTCODEC_UINT			0	// varint
+#define REPORTCODEC_STRING			1	// varint length, bytes
+#define REPORTCODEC_ARRAY			2	// varint count, varints
+
+// Reports
+enum {
+	REPORTCODEC_STATUS = 1,
+	REPORTCODEC_BILL_ACCEPTED,
+	REPORTCODEC_DISPENSE,
+	REPORTCODEC_TRANSACTION,
+	REPORTCODEC_STATUS_DELTA		// Status fields, the changed ones only
+};
+
+// Field ids, named after the JSON keys
+enum {
+	REPORTCODEC_STATUS_V = 1,
+	REPORTCODEC_STATUS_CON_TYPE,
+	REPORTCODEC_STATUS_PWD,
+	REPORTCODEC_STATUS_CP,
+	REPORTCODEC_STATUS_AMT,
+	REPORTCODEC_STATUS_TO_AMT,
+	REPORTCODEC_STATUS_TO_CA,
+	REPORTCODEC_STATUS_TO_CA_D,
+	REPORTCODEC_STATUS_TO_CA_M,
+	REPORTCODEC_STATUS_TCD_1,
+	REPORTCODEC_STATUS_TCD_2,
+	REPORTCODEC_STATUS_BILL,
+	REPORTCODEC_STATUS_OB,
+	REPORTCODEC_STATUS_MP
+};
+
+enum {
+	REPORTCODEC_BILL_ACCEPTED_VALUE = 1
+};
+
+enum {
+	REPORTCODEC_DISPENSE_DIR = 1
+};
+
+enum {
+	REPORTCODEC_TRANSACTION_PRICE = 1,
+	REPORTCODEC_TRANSACTION_QUANTITY
+};
+
+typedef struct {
+	uint8_t buf[REPORTCODEC_FRAME_MAX_LEN];
+	size_t len;
+	bool overflow;
+}REPORTCODEC_t;
+
+void REPORTCODEC_begin(REPORTCODEC_t * codec, uint8_t report);
+void REPORTCODEC_uint(REPORTCODEC_t * codec, uint8_t field, uint32_t value);
+void REPORTCODEC_string(REPORTCODEC_t * codec, uint8_t field, const char * value, size_t max_len);
+void REPORTCODEC_array(REPORTCODEC_t * codec, uint8_t field, const uint32_t * values, uint8_t count);
+bool REPORTCODEC_end(REPORTCODEC_t * codec, char * out, size_t out_size);
+bool REPORTCODEC_is_binary(const char * payload);
+
+#endif /* INC_APP_REPORTCODEC_H_ */
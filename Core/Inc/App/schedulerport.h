@@ -8,6 +8,23 @@
 #ifndef INC_APP_SCHEDULERPORT_H_
 #define INC_APP_SCHEDULERPORT_H_
 
+#include "stdio.h"
+#include "stdbool.h"
+
+// Sleep with the 1ms tick suppressed until the next scheduler deadline
+#ifndef SCHEDULERPORT_TICKLESS
+#define SCHEDULERPORT_TICKLESS		1
+#endif
+#define SCHEDULERPORT_MAX_SLEEP		50	// 50ms, bounded by the 16-bit TIM3 counter
+
+typedef struct {
+	uint32_t sleep_count;	// Number of WFI entries
+	uint32_t sleep_ms;		// Time spent in WFI
+	uint32_t busy_ms;		// Time spent running since init
+}SCHEDULERPORT_stats_t;
+
 void SCHEDULERPORT_init();
+void SCHEDULERPORT_sleep();
+void SCHEDULERPORT_get_stats(SCHEDULERPORT_stats_t * stats);
 
 #endif /* INC_APP_SCHEDULERPORT_H_ */
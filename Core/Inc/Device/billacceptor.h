@@ -9,8 +9,40 @@
 #define INC_DEVICE_BILLACCEPTOR_H_
 
 #include "stdio.h"
+#include "stdint.h"
 #include "stdbool.h"
 
+// Commands waiting for the link, a command is queued by each BILLACCEPTOR_<cmd> call
+#ifndef BILLACCEPTOR_QUEUE_SIZE
+#define BILLACCEPTOR_QUEUE_SIZE		8
+#endif
+#define BILLACCEPTOR_CMD_MAX		5	// Command code + data, without checksum
+// A POLL response is up to 16 event bytes + checksum
+#define BILLACCEPTOR_POLL_EVENT_MAX	16
+
+typedef enum {
+	BILLACCEPTOR_RESET = 0x30,
+	BILLACCEPTOR_SETUP = 0x31,
+	BILLACCEPTOR_SECURITY = 0x32,
+	BILLACCEPTOR_POLL = 0x33,
+	BILLACCEPTOR_BILLTYPE = 0x34,
+	BILLACCEPTOR_ESCROW = 0x35,
+	BILLACCEPTOR_STACKER = 0x36,
+	BILLACCEPTOR_EXPANSION_CMD = 0x37
+}BILLACCEPTOR_Cmd_Code_t;
+
+typedef enum {
+	BILLACCEPTOR_RESULT_OK,
+	BILLACCEPTOR_RESULT_TIMEOUT,
+	BILLACCEPTOR_RESULT_NAK,		// Validator answered with something else than ACK
+	BILLACCEPTOR_RESULT_CHK_ERROR
+}BILLACCEPTOR_Result_t;
+
+// Called from BILLACCEPTOR_run when a queued command completes, its output struct is filled on success
+typedef void (*BILLACCEPTOR_Done_cb)(uint8_t cmd, BILLACCEPTOR_Result_t result);
+// Called from interrupt or task context when BILLACCEPTOR_run has work to do
+typedef void (*BILLACCEPTOR_Wake_cb)(void);
+
 typedef struct {
 	uint8_t feature_level;
 	uint8_t currency_code[2];
@@ -50,6 +82,12 @@ typedef struct {
 	BILLACCEPTOR_PollType_t type;
 }BILLACCEPTOR_Poll_t;
 
+// Every event of one POLL response, oldest first. No event when the validator answered ACK.
+typedef struct {
+	BILLACCEPTOR_Poll_t events[BILLACCEPTOR_POLL_EVENT_MAX];
+	uint8_t event_count;
+}BILLACCEPTOR_PollEvents_t;
+
 typedef struct {
 	uint16_t bill_enable;
 	uint16_t bill_escrow_enable;
@@ -66,10 +104,16 @@ typedef struct {
 }BILLACCEPTOR_Stacker_t;
 
 bool BILLACCEPTOR_init();
+void BILLACCEPTOR_run();
+bool BILLACCEPTOR_is_busy();
+void BILLACCEPTOR_set_done_callback(BILLACCEPTOR_Done_cb callback);
+void BILLACCEPTOR_set_wake_callback(BILLACCEPTOR_Wake_cb callback);
+// Commands are queued and return false when the queue is full. Output structs
+// (setup, poll, stacker) must stay valid until the done callback.
 bool BILLACCEPTOR_reset();
 bool BILLACCEPTOR_setup(BILLACCEPTOR_Setup_t *setup);
 bool BILLACCEPTOR_security(BILLACCEPTOR_Security_t * security);
-bool BILLACCEPTOR_poll(BILLACCEPTOR_Poll_t * poll);
+bool BILLACCEPTOR_poll(BILLACCEPTOR_PollEvents_t * poll);
 bool BILLACCEPTOR_billtype(BILLACCEPTOR_BillType_t * billtype);
 bool BILLACCEPTOR_escrow(BILLACCEPTOR_Escrow_t * escrow);
 bool BILLACCEPTOR_stacker(BILLACCEPTOR_Stacker_t * stacker);
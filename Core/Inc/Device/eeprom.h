@@ -11,9 +11,16 @@
 #include "stdio.h"
 #include "stdbool.h"
 
+#define EEPROM_PAGE_SIZE	32	// A write must not cross a page boundary
+
+// Called from the I2C interrupt once the last page of a write is acknowledged
+typedef void (*EEPROM_cb)(bool success, void * arg);
+
 bool EEPROM_init();
 bool EEPROM_read(uint16_t address , uint8_t * data, size_t data_len);
 bool EEPROM_write(uint16_t address , uint8_t * data, size_t data_len);
+bool EEPROM_write_cb(uint16_t address , uint8_t * data, size_t data_len, EEPROM_cb cb, void * arg);
+void EEPROM_sync();
 // For test IO
 bool EEPROM_test();
 
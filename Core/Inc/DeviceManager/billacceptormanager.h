@@ -12,6 +12,14 @@
 #include "stdbool.h"
 #include "Device/billacceptor.h"
 
+// Adaptive POLL interval: fast while bills are fed, doubled after each quiet POLL up to the slow interval
+#ifndef BILLACCEPTORMNG_POLL_FAST
+#define BILLACCEPTORMNG_POLL_FAST		50		// 50ms
+#endif
+#ifndef BILLACCEPTORMNG_POLL_SLOW
+#define BILLACCEPTORMNG_POLL_SLOW		1600	// 1.6s
+#endif
+
 /**
  * Status
  */
@@ -32,6 +40,18 @@ enum {
 	STATUS_NB_ATTEMP_INPUT_BILL = 0x0D
 };
 
+typedef struct {
+	uint32_t poll_count;			// POLL answered by the validator
+	uint32_t event_count;			// Events decoded from all the POLL responses
+	uint32_t multi_event_poll_count;	// POLL carrying more than one event
+	uint8_t max_events_per_poll;
+	uint32_t poll_interval;			// Current interval between two POLL (ms)
+	uint32_t fast_poll_count;		// POLL sent at BILLACCEPTORMNG_POLL_FAST
+	uint32_t no_response_count;		// POLL failed (timeout, NAK or checksum)
+	uint32_t response_time_total;	// From queued to answered (ms), average = total / poll_count
+	uint32_t response_time_max;
+}BILLACCEPTORMNG_stats_t;
+
 bool BILLACCEPTORMNG_init();
 bool BILLACCEPTORMNG_run();
 uint8_t BILLACCEPTORMNG_get_state();
@@ -45,6 +65,8 @@ void BILLACCEPTORMNG_set_amount(uint32_t _amount);
 void BILLACCEPTORMNG_enable();
 void BILLACCEPTORMNG_disable();
 bool BILLACCEPTORMNG_is_enabled();
+void BILLACCEPTORMNG_get_stats(BILLACCEPTORMNG_stats_t * stats);
+void BILLACCEPTORMNG_notify_activity();
 
 
 #endif /* INC_DEVICEMANAGER_BILLACCEPTORMANAGER_H_ */
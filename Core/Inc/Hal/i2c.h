@@ -9,14 +9,39 @@
 #define INC_HAL_I2C_H_
 
 #include "stdio.h"
+#include "stdint.h"
 #include "stdbool.h"
 
+// Both bounds hold inside an interrupt that masks SysTick (the PVD flush): the timeout
+// runs on the DWT cycle counter and the ACK polling counts its attempts
 #define I2C_TIMEOUT	200 	// 200ms
+#define I2C_ACK_POLL_MAX		1000	// Addressing attempts while a device NACKs (EEPROM write cycle), 25ms at 400 kHz
+#define I2C_QUEUE_SIZE			8		// Transactions waiting for the bus
+#define I2C_WRITE_MAX_LEN		32		// Bytes of a write, copied in the queue
+#define I2C_DEVICE_MAX			4
+
+// Device flags
+#define I2C_FAST				(1 << 0)	// 400 kHz, the bus runs at 100 kHz otherwise
+#define I2C_ACK_POLL			(1 << 1)	// Retry while the device NACKs its address
+
+// Called from the I2C interrupt when the transaction is done
+typedef void (*I2C_cb)(bool success, void * arg);
 
 void I2C_init();
+bool I2C_set_device_flags(uint8_t address, uint8_t flags);
 bool I2C_write(uint8_t address, uint8_t * data_w, size_t w_len);
 bool I2C_write_and_read(uint8_t address, uint8_t * data_w, size_t w_len, uint8_t * data_r, size_t r_len);
 bool I2C_read(uint8_t address, uint8_t * data_r, size_t r_len);
 bool I2C_mem_write(uint8_t address, uint16_t mem_address, uint16_t mem_size, uint8_t * data_w, size_t w_len);
+bool I2C_mem_read(uint8_t address, uint16_t mem_address, uint16_t mem_size, uint8_t * data_r, size_t r_len);
+// Queue the transaction and return, false when the queue is full.
+// The write data is copied, the read buffer must stay valid until the callback
+bool I2C_mem_write_async(uint8_t address, uint16_t mem_address, uint16_t mem_size, uint8_t * data_w, size_t w_len, I2C_cb cb, void * arg);
+bool I2C_mem_read_async(uint8_t address, uint16_t mem_address, uint16_t mem_size, uint8_t * data_r, size_t r_len, I2C_cb cb, void * arg);
+bool I2C_is_idle();
+void I2C_poll();
+void I2C_wait();
+uint32_t I2C_get_error_count();
+uint32_t I2C_get_recover_count();
 
 #endif /* INC_HAL_I2C_H_ */
@@ -0,0 +1,28 @@
+/*
+ * power.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: agent
+ */
+
+#ifndef INC_HAL_POWER_H_
+#define INC_HAL_POWER_H_
+
+#include "stdio.h"
+#include "stdbool.h"
+
+// PVD threshold, 2.9V leaves the EEPROM a few write cycles before the brown-out reset
+#ifndef POWER_PVD_LEVEL
+#define POWER_PVD_LEVEL		PWR_PVDLEVEL_7
+#endif
+// Below the I2C interrupts, so that a write waited for in the callback can complete
+#define POWER_PVD_PRIORITY	1
+
+typedef void (*POWER_fn)(void);
+
+bool POWER_init();
+bool POWER_attach_fail(POWER_fn fn);
+bool POWER_is_low();
+uint32_t POWER_get_fail_count();
+
+#endif /* INC_HAL_POWER_H_ */
@@ -11,10 +11,15 @@
 #include "stdio.h"
 #include "stdbool.h"
 
+#define TIMER_COUNTS_PER_TICK		1000	// TIM3 counts for one 1ms interrupt
+
 typedef void (*TIMER_fn)(void);
 
 bool TIMER_init();
 bool TIMER_attach_intr_1ms(void (*fn)(void));
+uint32_t TIMER_suppress_intr_1ms(uint32_t ticks);
+uint32_t TIMER_resume_intr_1ms();
+uint32_t TIMER_get_counts();
 void TIMER_test();
 
 #endif /* INC_HAL_TIMER_H_ */
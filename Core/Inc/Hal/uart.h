@@ -21,11 +21,47 @@ typedef enum {
 	UART_MAX
 }UART_id_t;
 
+// Reception of the WIFI/4G UARTs: 1 = circular DMA ring, 0 = one interrupt per byte
+#ifndef UART1_RX_DMA
+#define UART1_RX_DMA			1
+#endif
+#ifndef UART4_RX_DMA
+#define UART4_RX_DMA			1
+#endif
+// Bytes in each DMA ring (power of two). Half of it is the DMA write-ahead, so unread
+// bytes last 22ms at 115200 baud before they count as overwritten
+#ifndef UART_DMA_RING_SIZE
+#define UART_DMA_RING_SIZE		512
+#endif
+// Transmit queues serviced by DMA, UART_send copies and returns without waiting.
+// Bytes for UART_1/UART_4, 9-bit words for UART_2. A send that does not fit is refused
+#ifndef UART_TX_QUEUE_SIZE
+#define UART_TX_QUEUE_SIZE		512
+#endif
+#define UART_MDB_TX_QUEUE_SIZE	80
+// Frame reception (UART_2, MDB): a frame ends on the word with the 9th bit set
+#define UART_FRAME_MAX_LEN		36
+#define UART_FRAME_QUEUE_SIZE	4
+
+typedef void (*UART_rx_cb)(void);
+typedef void (*UART_tx_cb)(void);
+
 bool UART_init();
 bool UART_send(UART_id_t id, uint8_t *data , size_t len);
 bool UART_receive_available(UART_id_t id);
 uint16_t UART_receive_data(UART_id_t id);
+size_t UART_receive(UART_id_t id, uint8_t * data, size_t len);
+size_t UART_peek(UART_id_t id, uint8_t * data, size_t len);
 void UART_clear_buffer(UART_id_t id);
+bool UART_receive_frame_available(UART_id_t id);
+bool UART_receive_frame(UART_id_t id, uint16_t * data, size_t * len);
+uint32_t UART_get_frame_drop_count(UART_id_t id);
+uint32_t UART_get_overrun_count(UART_id_t id);
+uint32_t UART_get_rx_high_water(UART_id_t id);
+void UART_set_rx_callback(UART_id_t id, UART_rx_cb callback);
+size_t UART_get_tx_free(UART_id_t id);
+uint32_t UART_get_tx_drop_count(UART_id_t id);
+void UART_set_tx_callback(UART_id_t id, UART_tx_cb callback);
 void UART_test();
 
 
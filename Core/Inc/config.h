@@ -28,6 +28,17 @@
 	#define DEVICE_ID_DEFAULT		"123456"
 #endif
 
+// Changes given to CONFIG_set are written to the EEPROM once the main loop is idle,
+// so that the fields changed by one sale go out together, or at the latest after
+// this delay (ms) when the loop stays busy
+#ifndef CONFIG_FLUSH_DELAY
+#define CONFIG_FLUSH_DELAY		100
+#endif
+
+// Encoding of the reports, see App/reportcodec.h
+#define CONFIG_REPORT_JSON		0
+#define CONFIG_REPORT_BINARY	1
+
 typedef struct {
 	char version[VERSION_MAX_LEN];
 	char device_id[DEVICE_ID_MAX_LEN];
@@ -38,13 +49,29 @@ typedef struct {
 	uint32_t total_card;
 	uint32_t total_card_by_day;
 	uint32_t total_card_by_month;
+	uint8_t report_format;
 }CONFIG_t;
 
+// Write-back timings, in ms
+typedef struct {
+	uint32_t flush_count;			// Flushes that wrote to the EEPROM
+	uint32_t power_fail_count;		// Flushes started by the PVD
+	uint32_t write_error_count;		// Writes the EEPROM did not acknowledge
+	uint32_t flush_ms_last;			// First write queued -> last write acknowledged
+	uint32_t flush_ms_max;
+	uint32_t dirty_ms_last;			// First change -> on the EEPROM
+	uint32_t dirty_ms_max;
+}CONFIG_stats_t;
+
 bool CONFIG_init();
 CONFIG_t * CONFIG_get();
 void CONFIG_set(CONFIG_t *);
+void CONFIG_flush();
+void CONFIG_idle();
+void CONFIG_sync();
 void CONFIG_reset_default();
 void CONFIG_clear();
+void CONFIG_get_stats(CONFIG_stats_t * stats);
 void CONFIG_test();
 
 #endif /* INC_APP_CONFIG_H_ */
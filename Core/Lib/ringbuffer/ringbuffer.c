@@ -0,0 +1,165 @@
+/*
+ * ringbuffer.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: agent
+ */
+#include "ringbuffer.h"
+#include "string.h"
+
+// Keep the data accesses on their side of the head/tail update
+#define RINGBUFFER_BARRIER()	__sync_synchronize()
+
+static void RINGBUFFER_update_high_water(RINGBUFFER_t * rb, uint32_t used);
+static uint32_t RINGBUFFER_used(RINGBUFFER_t * rb);
+static void RINGBUFFER_copy_out(RINGBUFFER_t * rb, uint32_t from, uint8_t * data, size_t len);
+
+bool RINGBUFFER_init(RINGBUFFER_t * rb, uint8_t * buf, size_t size){
+	if(size == 0 || (size & (size - 1)) != 0){
+		return false;
+	}
+	rb->buf = buf;
+	rb->mask = size - 1;
+	rb->head = 0;
+	rb->tail = 0;
+	rb->high_water = 0;
+	rb->drop_count = 0;
+	rb->overwrite_count = 0;
+	rb->write_ahead = 0;
+	return true;
+}
+
+bool RINGBUFFER_push(RINGBUFFER_t * rb, uint8_t data){
+	uint32_t head = rb->head;
+	uint32_t used = head - rb->tail;
+	if(used > rb->mask){
+		rb->drop_count++;
+		return false;
+	}
+	rb->buf[head & rb->mask] = data;
+	RINGBUFFER_BARRIER();
+	rb->head = head + 1;
+	RINGBUFFER_update_high_water(rb, used + 1);
+	return true;
+}
+
+/**
+ * Write as many bytes as fit, the rest is counted as dropped
+ */
+size_t RINGBUFFER_write(RINGBUFFER_t * rb, const uint8_t * data, size_t len){
+	uint32_t head = rb->head;
+	uint32_t used = head - rb->tail;
+	uint32_t offset = head & rb->mask;
+	size_t first;
+	if(len > rb->mask + 1 - used){
+		rb->drop_count += len - (rb->mask + 1 - used);
+		len = rb->mask + 1 - used;
+	}
+	first = rb->mask + 1 - offset;
+	if(first > len){
+		first = len;
+	}
+	memcpy(rb->buf + offset, data, first);
+	memcpy(rb->buf, data + first, len - first);
+	RINGBUFFER_BARRIER();
+	rb->head = head + len;
+	RINGBUFFER_update_high_water(rb, used + len);
+	return len;
+}
+
+/**
+ * Publish len bytes already stored after the head (by a DMA for example).
+ * The producer does not wait for the consumer, bytes not read in time are
+ * overwritten and the consumer skips them.
+ */
+void RINGBUFFER_commit(RINGBUFFER_t * rb, size_t len){
+	uint32_t head = rb->head + len;
+	RINGBUFFER_BARRIER();
+	rb->head = head;
+	RINGBUFFER_update_high_water(rb, head - rb->tail);
+}
+
+/**
+ * A producer that writes in place (a DMA) is up to len bytes past the committed head.
+ * The consumer counts those as overwritten already
+ */
+void RINGBUFFER_set_write_ahead(RINGBUFFER_t * rb, size_t len){
+	rb->write_ahead = len;
+}
+
+size_t RINGBUFFER_free(RINGBUFFER_t * rb){
+	uint32_t used = rb->head - rb->tail;
+	return used > rb->mask ? 0 : rb->mask + 1 - used;
+}
+
+size_t RINGBUFFER_available(RINGBUFFER_t * rb){
+	return RINGBUFFER_used(rb);
+}
+
+bool RINGBUFFER_pop(RINGBUFFER_t * rb, uint8_t * data){
+	return RINGBUFFER_read(rb, data, 1) == 1;
+}
+
+size_t RINGBUFFER_read(RINGBUFFER_t * rb, uint8_t * data, size_t len){
+	len = RINGBUFFER_peek(rb, data, len);
+	RINGBUFFER_BARRIER();
+	rb->tail += len;
+	return len;
+}
+
+/**
+ * Copy up to len of the oldest bytes without taking them
+ */
+size_t RINGBUFFER_peek(RINGBUFFER_t * rb, uint8_t * data, size_t len){
+	uint32_t used = RINGBUFFER_used(rb);
+	if(len > used){
+		len = used;
+	}
+	RINGBUFFER_BARRIER();
+	RINGBUFFER_copy_out(rb, rb->tail, data, len);
+	return len;
+}
+
+size_t RINGBUFFER_skip(RINGBUFFER_t * rb, size_t len){
+	uint32_t used = RINGBUFFER_used(rb);
+	if(len > used){
+		len = used;
+	}
+	rb->tail += len;
+	return len;
+}
+
+void RINGBUFFER_clear(RINGBUFFER_t * rb){
+	rb->tail = rb->head;
+}
+
+static void RINGBUFFER_update_high_water(RINGBUFFER_t * rb, uint32_t used){
+	if(used > rb->high_water){
+		rb->high_water = used;
+	}
+}
+
+/**
+ * Bytes waiting for the consumer, after skipping the ones already overwritten
+ * or about to be by the write ahead
+ */
+static uint32_t RINGBUFFER_used(RINGBUFFER_t * rb){
+	uint32_t used = rb->head - rb->tail;
+	uint32_t capacity = rb->mask + 1 - rb->write_ahead;
+	if(used > capacity){
+		rb->overwrite_count += used - capacity;
+		rb->tail += used - capacity;
+		used = capacity;
+	}
+	return used;
+}
+
+static void RINGBUFFER_copy_out(RINGBUFFER_t * rb, uint32_t from, uint8_t * data, size_t len){
+	uint32_t offset = from & rb->mask;
+	size_t first = rb->mask + 1 - offset;
+	if(first > len){
+		first = len;
+	}
+	memcpy(data, rb->buf + offset, first);
+	memcpy(data + first, rb->buf, len - first);
+}
@@ -0,0 +1,45 @@
+/*
+ * ringbuffer.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: agent
+ */
+
+#ifndef LIB_RINGBUFFER_H_
+#define LIB_RINGBUFFER_H_
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "stddef.h"
+
+// Single producer (usually an interrupt), single consumer (the main loop), no lock.
+// head is only written by the producer, tail only by the consumer. Both count bytes
+// since init and wrap at 2^32, the size must be a power of two so that they index
+// the buffer with a mask.
+typedef struct {
+	uint8_t * buf;
+	uint32_t mask;				// Size - 1
+	volatile uint32_t head;		// Bytes written
+	volatile uint32_t tail;		// Bytes read
+	uint32_t high_water;		// Most bytes seen waiting, updated by the producer
+	uint32_t drop_count;		// Bytes refused because the ring was full, updated by the producer
+	uint32_t overwrite_count;	// Bytes overwritten by RINGBUFFER_commit before being read, updated by the consumer
+	uint32_t write_ahead;		// Bytes the producer may write past the head before committing them
+}RINGBUFFER_t;
+
+bool RINGBUFFER_init(RINGBUFFER_t * rb, uint8_t * buf, size_t size);
+// Producer
+bool RINGBUFFER_push(RINGBUFFER_t * rb, uint8_t data);
+size_t RINGBUFFER_write(RINGBUFFER_t * rb, const uint8_t * data, size_t len);
+void RINGBUFFER_commit(RINGBUFFER_t * rb, size_t len);
+void RINGBUFFER_set_write_ahead(RINGBUFFER_t * rb, size_t len);
+size_t RINGBUFFER_free(RINGBUFFER_t * rb);
+// Consumer
+size_t RINGBUFFER_available(RINGBUFFER_t * rb);
+bool RINGBUFFER_pop(RINGBUFFER_t * rb, uint8_t * data);
+size_t RINGBUFFER_read(RINGBUFFER_t * rb, uint8_t * data, size_t len);
+size_t RINGBUFFER_peek(RINGBUFFER_t * rb, uint8_t * data, size_t len);
+size_t RINGBUFFER_skip(RINGBUFFER_t * rb, size_t len);
+void RINGBUFFER_clear(RINGBUFFER_t * rb);
+
+#endif /* LIB_RINGBUFFER_H_ */
@@ -6,145 +6,468 @@
  */
 #include "scheduler.h"
 
+#if SCH_MAX_TASKS > 254
+#error "SCH_MAX_TASKS must fit in the 8-bit task index"
+#endif
 
-#define INTERRUPT_CYCLE			10 // 10 milliseconds
-#define PRESCALER				64
-#define COUNTER_START 			65536 - INTERRUPT_CYCLE * 1000 * 16 / 64	// 16M is Core Clock
+#define SCH_NIL					0xFF
+#define SCH_ID_INDEX_BITS		8
+#define SCH_ID_INDEX_MASK		((1UL << SCH_ID_INDEX_BITS) - 1)
+#define SCH_WHEEL_SLOTS			(1UL << SCH_WHEEL_BITS)
+#define SCH_WHEEL_MASK			(SCH_WHEEL_SLOTS - 1)
+#define SCH_WHEEL_MAX_DELAY		((1UL << (SCH_WHEEL_BITS * SCH_WHEEL_LEVELS)) - 1)
+
+typedef struct {
+	uint8_t Head;
+	uint8_t Tail;
+} sList;
 
 typedef struct {
 	void ( * pTask)(void);
-	uint32_t Delay;
+	uint32_t Expire;
 	uint32_t Period;
-	uint8_t RunMe;
-	uint32_t TaskID;
+	uint32_t TaskID;	// Current or last handle of the slot
+	sList * pList;		// List the task is linked in, 0 when free
+	uint8_t Priority;
+	uint8_t Next;
+	uint8_t Prev;
 } sTask;
 
-// The array of tasks
+// The pool of tasks
 static sTask SCH_tasks_G[SCH_MAX_TASKS];
-static uint8_t array_Of_Task_ID[SCH_MAX_TASKS];
-static uint32_t newTaskID = 0;
-static uint32_t rearQueue = 0;
-static uint32_t count_SCH_Update = 0;
+// Timer wheel, ready queue and free list
+static sList SCH_wheel_G[SCH_WHEEL_LEVELS][SCH_WHEEL_SLOTS];
+static sList SCH_ready_G[SCH_PRIORITY_LEVELS];
+static sList SCH_batch_G[SCH_PRIORITY_LEVELS];
+static sList SCH_free_G;
+// Dispatch latency per task function
+static SCH_Stats_t SCH_stats_G[SCH_STATS_MAX];
+static uint8_t SCH_stats_len = 0;
+static SCH_Run_Hook SCH_run_hook = 0;
+// Ticks counted by SCH_Update and ticks already processed by the wheel
+static volatile uint32_t SCH_ticks = 0;
+static uint32_t SCH_wheel_time = 0;
+static uint32_t SCH_overflow_count = 0;
+static uint32_t SCH_missed_count = 0;
+// Dispatches of a task that had to wait behind a higher priority one
+static uint32_t SCH_starvation_count[SCH_PRIORITY_LEVELS];
+static uint32_t SCH_run_count = 0;
 
 
-static uint32_t Get_New_Task_ID(void);
-static void TIMER_Init();
+static uint32_t Get_New_Task_ID(uint8_t index);
+static uint8_t Get_Task_Index(uint32_t taskID);
+static void List_Init(sList * list);
+static void List_Append(sList * list, uint8_t index);
+static void List_Remove(uint8_t index);
+static void Wheel_Insert(uint8_t index);
+static void Wheel_Cascade(uint8_t level);
+static void Wheel_Advance(void);
+static void Wheel_Catch_Up(void);
+static void Ready_To_Batch(uint8_t priority);
+static void Stats_Update(void (* pTask)(void), uint32_t late, uint32_t missed);
 
 
 void SCH_Init(void){
-	// Do nothing
+	uint8_t level;
+	uint32_t slot;
+	for(level = 0; level < SCH_PRIORITY_LEVELS; level ++){
+		List_Init(&SCH_ready_G[level]);
+		List_Init(&SCH_batch_G[level]);
+		SCH_starvation_count[level] = 0;
+	}
+	List_Init(&SCH_free_G);
+	for(level = 0; level < SCH_WHEEL_LEVELS; level ++){
+		for(slot = 0; slot < SCH_WHEEL_SLOTS; slot ++){
+			List_Init(&SCH_wheel_G[level][slot]);
+		}
+	}
+	for(uint8_t i = 0; i < SCH_MAX_TASKS; i ++){
+		SCH_tasks_G[i].pTask = 0;
+		SCH_tasks_G[i].TaskID = NO_TASK_ID;
+		SCH_tasks_G[i].pList = 0;
+		List_Append(&SCH_free_G, i);
+	}
+	SCH_wheel_time = SCH_ticks;
 }
 
 void SCH_Update(void){
-	// Check if there is a task at this location
-	count_SCH_Update ++;
-	if (SCH_tasks_G[0].pTask && SCH_tasks_G[0].RunMe == 0) {
-		if(SCH_tasks_G[0].Delay > 0){
-			SCH_tasks_G[0].Delay = SCH_tasks_G[0].Delay - 1;
-		}
-		if (SCH_tasks_G[0].Delay == 0) {
-			SCH_tasks_G[0].RunMe = 1;
-		}
-	}
+	// Only count the tick here, the wheel is advanced from SCH_Dispatch_Tasks
+	SCH_ticks ++;
+}
+
+void SCH_Update_Ticks(uint32_t ticks){
+	// Account for ticks whose interrupt was suppressed while sleeping
+	SCH_ticks += ticks;
 }
+
 uint32_t SCH_Add_Task(void (* pFunction)(), uint32_t DELAY, uint32_t PERIOD){
-	uint8_t newTaskIndex = 0;
-	uint32_t sumDelay = 0;
-	uint32_t newDelay = 0;
-
-	for(newTaskIndex = 0; newTaskIndex < SCH_MAX_TASKS; newTaskIndex ++){
-		sumDelay = sumDelay + SCH_tasks_G[newTaskIndex].Delay;
-		if(sumDelay > DELAY){
-			newDelay = DELAY - (sumDelay - SCH_tasks_G[newTaskIndex].Delay);
-			SCH_tasks_G[newTaskIndex].Delay = sumDelay - DELAY;
-			for(uint8_t i = SCH_MAX_TASKS - 1; i > newTaskIndex; i --){
-//				if(SCH_tasks_G[i - 1].pTask != 0)
-				{
-					SCH_tasks_G[i].pTask = SCH_tasks_G[i - 1].pTask;
-					SCH_tasks_G[i].Period = SCH_tasks_G[i - 1].Period;
-					SCH_tasks_G[i].Delay = SCH_tasks_G[i - 1].Delay;
-//					SCH_tasks_G[i].RunMe = SCH_tasks_G[i - 1].RunMe;
-					SCH_tasks_G[i].TaskID = SCH_tasks_G[i - 1].TaskID;
-				}
-			}
-			SCH_tasks_G[newTaskIndex].pTask = pFunction;
-			SCH_tasks_G[newTaskIndex].Delay = newDelay;
-			SCH_tasks_G[newTaskIndex].Period = PERIOD;
-			if(SCH_tasks_G[newTaskIndex].Delay == 0){
-				SCH_tasks_G[newTaskIndex].RunMe = 1;
-			} else {
-				SCH_tasks_G[newTaskIndex].RunMe = 0;
-			}
-			SCH_tasks_G[newTaskIndex].TaskID = Get_New_Task_ID();
-			return SCH_tasks_G[newTaskIndex].TaskID;
-		} else {
-			if(SCH_tasks_G[newTaskIndex].pTask == 0x0000){
-				SCH_tasks_G[newTaskIndex].pTask = pFunction;
-				SCH_tasks_G[newTaskIndex].Delay = DELAY - sumDelay;
-				SCH_tasks_G[newTaskIndex].Period = PERIOD;
-				if(SCH_tasks_G[newTaskIndex].Delay == 0){
-					SCH_tasks_G[newTaskIndex].RunMe = 1;
-				} else {
-					SCH_tasks_G[newTaskIndex].RunMe = 0;
-				}
-				SCH_tasks_G[newTaskIndex].TaskID = Get_New_Task_ID();
-				return SCH_tasks_G[newTaskIndex].TaskID;
-			}
-		}
+	return SCH_Add_Task_Priority(pFunction, DELAY, PERIOD, SCH_PRIORITY_DEFAULT);
+}
+
+uint32_t SCH_Add_Task_Priority(void (* pFunction)(), uint32_t DELAY, uint32_t PERIOD, uint8_t PRIORITY){
+	uint8_t newTaskIndex = SCH_free_G.Head;
+	if(newTaskIndex == SCH_NIL){
+		SCH_overflow_count ++;
+		return NO_TASK_ID;
+	}
+	if(PRIORITY >= SCH_PRIORITY_LEVELS){
+		PRIORITY = SCH_PRIORITY_LEVELS - 1;
 	}
+	List_Remove(newTaskIndex);
+	SCH_tasks_G[newTaskIndex].pTask = pFunction;
+	SCH_tasks_G[newTaskIndex].Expire = SCH_ticks + DELAY;
+	SCH_tasks_G[newTaskIndex].Period = PERIOD;
+	SCH_tasks_G[newTaskIndex].Priority = PRIORITY;
+	SCH_tasks_G[newTaskIndex].TaskID = Get_New_Task_ID(newTaskIndex);
+	Wheel_Insert(newTaskIndex);
 	return SCH_tasks_G[newTaskIndex].TaskID;
 }
 
 
 uint8_t SCH_Delete_Task(uint32_t taskID){
-	uint8_t Return_code  = 0;
+	uint8_t taskIndex = Get_Task_Index(taskID);
+	if(taskIndex == SCH_NIL){
+		return 0;
+	}
+	List_Remove(taskIndex);
+	SCH_tasks_G[taskIndex].pTask = 0;
+	List_Append(&SCH_free_G, taskIndex);
+	return 1;
+}
+
+/**
+ * Move a pending task so it expires DELAY ticks from now, the period is kept.
+ * Returns 0 when the ID is stale (the task already ran or was deleted).
+ */
+uint8_t SCH_Reschedule(uint32_t taskID, uint32_t DELAY){
+	uint8_t taskIndex = Get_Task_Index(taskID);
+	if(taskIndex == SCH_NIL){
+		return 0;
+	}
+	List_Remove(taskIndex);
+	SCH_tasks_G[taskIndex].Expire = SCH_ticks + DELAY;
+	Wheel_Insert(taskIndex);
+	return 1;
+}
+
+uint8_t SCH_Is_Task_Alive(uint32_t taskID){
+	return Get_Task_Index(taskID) != SCH_NIL;
+}
+
+void SCH_Dispatch_Tasks(void){
+	SCH_Dispatch_Tasks_Priority(SCH_PRIORITY_LEVELS - 1);
+}
+
+/**
+ * Run the expired tasks whose priority is PRIORITY or higher, highest first.
+ * Lower classes stay ready for a later call, so this can be called between
+ * slow modules to keep the latency of critical tasks bounded.
+ */
+void SCH_Dispatch_Tasks_Priority(uint8_t PRIORITY){
 	uint8_t taskIndex;
-	uint8_t j;
-	if(taskID != NO_TASK_ID){
-		for(taskIndex = 0; taskIndex < SCH_MAX_TASKS; taskIndex ++){
-			if(SCH_tasks_G[taskIndex].TaskID == taskID){
-				Return_code = 1;
-				if(taskIndex != 0 && taskIndex < SCH_MAX_TASKS - 1){
-					if(SCH_tasks_G[taskIndex+1].pTask != 0x0000){
-						SCH_tasks_G[taskIndex+1].Delay += SCH_tasks_G[taskIndex].Delay;
-					}
-				}
+	uint8_t priority;
+	uint8_t ranPriority = SCH_PRIORITY_LEVELS;
+	uint32_t now;
+	uint32_t late;
+	uint32_t missed;
+	void (* pTask)(void);
+	if(PRIORITY >= SCH_PRIORITY_LEVELS){
+		PRIORITY = SCH_PRIORITY_LEVELS - 1;
+	}
+	// Catch up with the ticks counted in the interrupt
+	Wheel_Catch_Up();
+	now = SCH_wheel_time;
+	// Take every expired task as one batch. Tasks made ready while the batch
+	// runs (DELAY 0) wait for the next call so a task re-adding itself can not starve the loop.
+	for(priority = 0; priority <= PRIORITY; priority ++){
+		Ready_To_Batch(priority);
+	}
+	for(;;){
+		for(priority = 0; priority <= PRIORITY; priority ++){
+			if(SCH_batch_G[priority].Head != SCH_NIL){
+				break;
+			}
+		}
+		if(priority > PRIORITY){
+			break;
+		}
+		if(ranPriority < priority){
+			SCH_starvation_count[priority] ++;
+		}
+		if(priority < ranPriority){
+			ranPriority = priority;
+		}
+		taskIndex = SCH_batch_G[priority].Head;
+		List_Remove(taskIndex);
+		pTask = SCH_tasks_G[taskIndex].pTask;
+		late = now - SCH_tasks_G[taskIndex].Expire;
+		missed = 0;
+		if(SCH_tasks_G[taskIndex].Period != 0){
+			// Re-arm from the previous deadline so latency does not accumulate,
+			// periods which already passed are skipped and counted as missed
+			missed = late / SCH_tasks_G[taskIndex].Period;
+			SCH_tasks_G[taskIndex].Expire += (missed + 1) * SCH_tasks_G[taskIndex].Period;
+			SCH_missed_count += missed;
+			// Re-arm before running so the task may delete itself
+			Wheel_Insert(taskIndex);
+		}else{
+			// Release the slot before running so the task may add a new one
+			SCH_tasks_G[taskIndex].pTask = 0;
+			List_Append(&SCH_free_G, taskIndex);
+		}
+		Stats_Update(pTask, late, missed);
+		SCH_run_count ++;
+		if(SCH_run_hook){
+			SCH_run_hook(pTask);
+		}else{
+			(*pTask)(); // Run the task
+		}
+		// Critical tasks which expired while this one ran go before the rest of the batch
+		if(SCH_wheel_time != SCH_ticks){
+			Wheel_Catch_Up();
+			now = SCH_wheel_time;
+			Ready_To_Batch(SCH_PRIORITY_CRITICAL);
+		}
+	}
+}
+
+uint32_t SCH_Get_Overflow_Count(void){
+	return SCH_overflow_count;
+}
 
-				for( j = taskIndex; j < SCH_MAX_TASKS - 1; j ++){
-					SCH_tasks_G[j].pTask = SCH_tasks_G[j+1].pTask;
-					SCH_tasks_G[j].Period = SCH_tasks_G[j+1].Period;
-					SCH_tasks_G[j].Delay = SCH_tasks_G[j+1].Delay;
-					SCH_tasks_G[j].RunMe = SCH_tasks_G[j+1].RunMe;
-					SCH_tasks_G[j].TaskID = SCH_tasks_G[j+1].TaskID;
+uint32_t SCH_Get_Missed_Count(void){
+	return SCH_missed_count;
+}
+
+uint32_t SCH_Get_Starvation_Count(uint8_t PRIORITY){
+	if(PRIORITY >= SCH_PRIORITY_LEVELS){
+		return 0;
+	}
+	return SCH_starvation_count[PRIORITY];
+}
+
+/**
+ * Ticks until the wheel has something to do, 0 when a task is ready or
+ * ticks are waiting to be processed, SCH_NO_DEADLINE when no task is queued.
+ * Upper levels report their next cascade, which may be earlier than the task itself.
+ */
+uint32_t SCH_Get_Next_Deadline(void){
+	uint32_t deadline = SCH_NO_DEADLINE;
+	uint32_t ticks;
+	uint32_t slot;
+	uint8_t level;
+	uint8_t shift;
+	if(SCH_wheel_time != SCH_ticks){
+		return 0;
+	}
+	for(level = 0; level < SCH_PRIORITY_LEVELS; level ++){
+		if(SCH_ready_G[level].Head != SCH_NIL){
+			return 0;
+		}
+	}
+	for(level = 0; level < SCH_WHEEL_LEVELS; level ++){
+		shift = SCH_WHEEL_BITS * level;
+		for(slot = 1; slot <= SCH_WHEEL_SLOTS; slot ++){
+			if(SCH_wheel_G[level][((SCH_wheel_time >> shift) + slot) & SCH_WHEEL_MASK].Head != SCH_NIL){
+				ticks = (((SCH_wheel_time >> shift) + slot) << shift) - SCH_wheel_time;
+				if(ticks < deadline){
+					deadline = ticks;
 				}
-				SCH_tasks_G[j].pTask = 0;
-				SCH_tasks_G[j].Period = 0;
-				SCH_tasks_G[j].Delay = 0;
-				SCH_tasks_G[j].RunMe = 0;
-				SCH_tasks_G[j].TaskID = 0;
-				return Return_code;
+				break;
 			}
 		}
 	}
-	return Return_code; // return status
+	return deadline;
 }
 
-void SCH_Dispatch_Tasks(void){
-	if(SCH_tasks_G[0].RunMe > 0) {
-		(*SCH_tasks_G[0].pTask)(); // Run the task
-		SCH_tasks_G[0].RunMe = 0; // Reset / reduce RunMe flag
-		sTask temtask = SCH_tasks_G[0];
-		SCH_Delete_Task(temtask.TaskID);
-		if (temtask.Period != 0) {
-			SCH_Add_Task(temtask.pTask, temtask.Period, temtask.Period);
+uint32_t SCH_Get_Ticks(void){
+	return SCH_ticks;
+}
+
+uint32_t SCH_Get_Run_Count(void){
+	return SCH_run_count;
+}
+
+/**
+ * Copy the latency record at INDEX, returns 0 past the last tracked function.
+ */
+uint8_t SCH_Get_Stats(uint8_t index, SCH_Stats_t * stats){
+	if(index >= SCH_stats_len){
+		return 0;
+	}
+	*stats = SCH_stats_G[index];
+	return 1;
+}
+
+void SCH_Reset_Stats(void){
+	SCH_stats_len = 0;
+}
+
+void SCH_Set_Run_Hook(SCH_Run_Hook hook){
+	SCH_run_hook = hook;
+}
+
+static uint32_t Get_New_Task_ID(uint8_t index){
+	uint32_t generation = (SCH_tasks_G[index].TaskID >> SCH_ID_INDEX_BITS) + 1;
+	// Generation 0 is skipped on wrap so an ID is never NO_TASK_ID
+	generation &= (0xFFFFFFFFUL >> SCH_ID_INDEX_BITS);
+	if(generation == 0){
+		generation = 1;
+	}
+	return (generation << SCH_ID_INDEX_BITS) | index;
+}
+
+static uint8_t Get_Task_Index(uint32_t taskID){
+	uint32_t index = taskID & SCH_ID_INDEX_MASK;
+	if(taskID == NO_TASK_ID || index >= SCH_MAX_TASKS){
+		return SCH_NIL;
+	}
+	if(SCH_tasks_G[index].TaskID != taskID || SCH_tasks_G[index].pList == &SCH_free_G){
+		return SCH_NIL;
+	}
+	return index;
+}
+
+static void List_Init(sList * list){
+	list->Head = SCH_NIL;
+	list->Tail = SCH_NIL;
+}
+
+static void List_Append(sList * list, uint8_t index){
+	sTask * task = &SCH_tasks_G[index];
+	task->pList = list;
+	task->Next = SCH_NIL;
+	task->Prev = list->Tail;
+	if(list->Tail != SCH_NIL){
+		SCH_tasks_G[list->Tail].Next = index;
+	}else{
+		list->Head = index;
+	}
+	list->Tail = index;
+}
+
+static void List_Remove(uint8_t index){
+	sTask * task = &SCH_tasks_G[index];
+	sList * list = task->pList;
+	if(list == 0){
+		return;
+	}
+	if(task->Prev != SCH_NIL){
+		SCH_tasks_G[task->Prev].Next = task->Next;
+	}else{
+		list->Head = task->Next;
+	}
+	if(task->Next != SCH_NIL){
+		SCH_tasks_G[task->Next].Prev = task->Prev;
+	}else{
+		list->Tail = task->Prev;
+	}
+	task->pList = 0;
+	task->Next = SCH_NIL;
+	task->Prev = SCH_NIL;
+}
+
+static void Wheel_Insert(uint8_t index){
+	uint32_t expire = SCH_tasks_G[index].Expire;
+	int32_t delta = (int32_t)(expire - SCH_wheel_time);
+	uint8_t level;
+	if(delta <= 0){
+		// Already due
+		List_Append(&SCH_ready_G[SCH_tasks_G[index].Priority], index);
+		return;
+	}
+	if((uint32_t)delta > SCH_WHEEL_MAX_DELAY){
+		// Park it in the farthest slot, it is re-inserted when that slot cascades
+		expire = SCH_wheel_time + SCH_WHEEL_MAX_DELAY;
+		delta = SCH_WHEEL_MAX_DELAY;
+	}
+	for(level = 0; level < SCH_WHEEL_LEVELS - 1; level ++){
+		if((uint32_t)delta < (1UL << (SCH_WHEEL_BITS * (level + 1)))){
+			break;
 		}
 	}
+	List_Append(&SCH_wheel_G[level][(expire >> (SCH_WHEEL_BITS * level)) & SCH_WHEEL_MASK], index);
+}
+
+static void Wheel_Cascade(uint8_t level){
+	sList * list = &SCH_wheel_G[level][(SCH_wheel_time >> (SCH_WHEEL_BITS * level)) & SCH_WHEEL_MASK];
+	uint8_t index = list->Head;
+	uint8_t next;
+	List_Init(list);
+	for(; index != SCH_NIL; index = next){
+		next = SCH_tasks_G[index].Next;
+		SCH_tasks_G[index].pList = 0;
+		Wheel_Insert(index);
+	}
 }
 
-static uint32_t Get_New_Task_ID(void){
-	newTaskID++;
-	if(newTaskID == NO_TASK_ID){
-		newTaskID++;
+static void Stats_Update(void (* pTask)(void), uint32_t late, uint32_t missed){
+	uint8_t index;
+	SCH_Stats_t * stats;
+	for(index = 0; index < SCH_stats_len; index ++){
+		if(SCH_stats_G[index].pTask == pTask){
+			break;
+		}
+	}
+	if(index == SCH_stats_len){
+		if(SCH_stats_len >= SCH_STATS_MAX){
+			return;
+		}
+		stats = &SCH_stats_G[SCH_stats_len ++];
+		stats->pTask = pTask;
+		stats->RunCount = 0;
+		stats->LateCount = 0;
+		stats->LateTotal = 0;
+		stats->LateMax = 0;
+		stats->Missed = 0;
+	}
+	stats = &SCH_stats_G[index];
+	stats->RunCount ++;
+	stats->Missed += missed;
+	if(late != 0){
+		stats->LateCount ++;
+		stats->LateTotal += late;
+		if(late > stats->LateMax){
+			stats->LateMax = late;
+		}
+	}
+}
+
+static void Wheel_Catch_Up(void){
+	uint32_t now = SCH_ticks;
+	while(SCH_wheel_time != now){
+		Wheel_Advance();
+	}
+}
+
+static void Ready_To_Batch(uint8_t priority){
+	uint8_t index;
+	uint8_t next;
+	for(index = SCH_ready_G[priority].Head; index != SCH_NIL; index = next){
+		next = SCH_tasks_G[index].Next;
+		List_Remove(index);
+		List_Append(&SCH_batch_G[priority], index);
+	}
+}
+
+static void Wheel_Advance(void){
+	uint8_t level;
+	sList * list;
+	uint8_t index;
+	uint8_t next;
+	SCH_wheel_time ++;
+	// Move tasks of the upper levels down when the lower level wraps
+	for(level = 1; level < SCH_WHEEL_LEVELS; level ++){
+		if((SCH_wheel_time & ((1UL << (SCH_WHEEL_BITS * level)) - 1)) != 0){
+			break;
+		}
+		Wheel_Cascade(level);
+	}
+	// Everything in the current slot of level 0 expires now
+	list = &SCH_wheel_G[0][SCH_wheel_time & SCH_WHEEL_MASK];
+	for(index = list->Head; index != SCH_NIL; index = next){
+		next = SCH_tasks_G[index].Next;
+		List_Remove(index);
+		List_Append(&SCH_ready_G[SCH_tasks_G[index].Priority], index);
 	}
-	return newTaskID;
 }
@@ -10,15 +10,67 @@
 
 #include "stdint.h"
 
-
+// Capacity of the task pool, can be overridden from the build flags
+#ifndef SCH_MAX_TASKS
 #define SCH_MAX_TASKS 			40
+#endif
+// Task IDs are handles: slot index in the low 8 bits, slot generation above.
+// The generation changes each time the slot is reused so a stale ID is never
+// mistaken for the task now occupying the slot. A valid ID is never NO_TASK_ID.
 #define	NO_TASK_ID				0
+#define SCH_NO_DEADLINE			0xFFFFFFFF
+
+// Timer wheel geometry: SCH_WHEEL_LEVELS levels of 2^SCH_WHEEL_BITS slots,
+// the longest delay kept without re-cascading is 2^(SCH_WHEEL_BITS * SCH_WHEEL_LEVELS) ticks
+#define SCH_WHEEL_BITS			6
+#define SCH_WHEEL_LEVELS		4
+
+// Priority classes, lower value runs first when several tasks are due
+#define SCH_PRIORITY_CRITICAL	0	// Money and card dispensing
+#define SCH_PRIORITY_DEVICE		1	// Device polling
+#define SCH_PRIORITY_UI			2	// Screen and telemetry
+#define SCH_PRIORITY_LEVELS		3
+// Priority of the tasks added with SCH_Add_Task
+#define SCH_PRIORITY_DEFAULT	SCH_PRIORITY_DEVICE
+
+// Number of task functions whose dispatch latency is tracked
+#ifndef SCH_STATS_MAX
+#define SCH_STATS_MAX			16
+#endif
+
+typedef struct {
+	void (* pTask)(void);
+	uint32_t RunCount;
+	uint32_t LateCount;		// Runs dispatched after their deadline
+	uint32_t LateTotal;		// Sum of the late ticks, average = LateTotal / RunCount
+	uint32_t LateMax;
+	uint32_t Missed;		// Periods skipped because the task ran more than one period late
+}SCH_Stats_t;
+
+// Called instead of the task when set, it must call pTask itself (used for profiling)
+typedef void (* SCH_Run_Hook)(void (* pTask)(void));
 
 void SCH_Init(void);
 void SCH_Update(void);
+void SCH_Update_Ticks(uint32_t TICKS);
+// PERIOD != 0 makes a periodic task: it first runs after DELAY, then every PERIOD
+// ticks on absolute deadlines (no drift from dispatch latency) until deleted
 uint32_t SCH_Add_Task(void (*p_function)(), uint32_t DELAY, uint32_t PERIOD);
+uint32_t SCH_Add_Task_Priority(void (*p_function)(), uint32_t DELAY, uint32_t PERIOD, uint8_t PRIORITY);
 void SCH_Dispatch_Tasks(void);
+void SCH_Dispatch_Tasks_Priority(uint8_t PRIORITY);
 uint8_t SCH_Delete_Task(uint32_t TASK_ID);
+uint8_t SCH_Reschedule(uint32_t TASK_ID, uint32_t DELAY);
+uint8_t SCH_Is_Task_Alive(uint32_t TASK_ID);
+uint32_t SCH_Get_Overflow_Count(void);
+uint32_t SCH_Get_Missed_Count(void);
+uint32_t SCH_Get_Starvation_Count(uint8_t PRIORITY);
+uint32_t SCH_Get_Next_Deadline(void);
+uint32_t SCH_Get_Ticks(void);
+uint32_t SCH_Get_Run_Count(void);
+uint8_t SCH_Get_Stats(uint8_t INDEX, SCH_Stats_t * STATS);
+void SCH_Reset_Stats(void);
+void SCH_Set_Run_Hook(SCH_Run_Hook HOOK);
 
 
 #endif /* APP_SCHEDULER_H_ */
@@ -11,6 +11,8 @@
 #include "App/ota.h"
 #include "App/commandhandler.h"
 #include "App/mqtt.h"
+#include "App/msgpool.h"
+#include "App/eventbus.h"
 #include "Lib/jsmn/jsmn.h"
 #include "Lib/utils/utils_logger.h"
 
@@ -28,8 +30,6 @@ enum {
 };
 
 
-static MQTT_message_t message;
-
 static void COMMANDHANDLER_handle_config(uint8_t * payload, size_t payload_len);
 static void COMMANDHANDLER_handle_command(uint8_t * payload, size_t payload_len);
 static bool COMMANDHANDLER_parse_config(uint8_t *payload, size_t payload_len, CONFIG_t *config);
@@ -41,17 +41,23 @@ bool COMMANDHANDLER_init(){
 }
 
 bool COMMANDHANDLER_run(){
-	if(MQTT_receive_message(&message)){
-		switch (message.topic_id) {
+	MSGPOOL_handle_t handle;
+	MQTT_message_t * message;
+	if(MQTT_receive_message(&handle)){
+		message = MSGPOOL_get(handle);
+		switch (message->topic_id) {
 			case SUBTOPIC_CONFIG:
-				COMMANDHANDLER_handle_config(message.payload, strlen(message.payload));
+				COMMANDHANDLER_handle_config(message->payload, strlen(message->payload));
 				break;
 			case SUBTOPIC_COMMAND:
-				COMMANDHANDLER_handle_command(message.payload, strlen(message.payload));
+				COMMANDHANDLER_handle_command(message->payload, strlen(message->payload));
 				break;
 			default:
 				break;
 		}
+		MSGPOOL_release(handle);
+		// One message per pass, come back for the next one
+		EVENTBUS_post(EVENT_COMMAND);
 	}
 }
 
@@ -71,11 +77,13 @@ static void COMMANDHANDLER_handle_command(uint8_t * payload, size_t payload_len)
 		switch (command) {
 			case COMMAND_RESET:
 				utils_log_info("COMMAND_RESET\r\n");
+				CONFIG_sync();
 				NVIC_SystemReset();
 				break;
 			case COMMAND_OTA:
 				utils_log_info("COMMAND_OTA\r\n");
 				OTA_set_ota_requested();
+				CONFIG_sync();
 				NVIC_SystemReset();
 				break;
 			case COMMAND_RESET_DEFAULT_CONFIG:
@@ -132,6 +140,11 @@ static bool COMMANDHANDLER_parse_config(uint8_t *payload, size_t payload_len, CO
 			config->card_price = utils_string_to_int(payload + t[i + 1].start, t[i + 1].end - t[i + 1].start);
 			utils_log_debug("- Card Price: %d\r\n", config->card_price);
 			i++;
+		} else if (jsmn_streq(payload, &t[i], "fmt") == 0) {
+			config->report_format = utils_string_to_int(payload + t[i + 1].start, t[i + 1].end - t[i + 1].start) == CONFIG_REPORT_BINARY ?
+										CONFIG_REPORT_BINARY : CONFIG_REPORT_JSON;
+			utils_log_debug("- Report format: %d\r\n", config->report_format);
+			i++;
 		}
 	}
 	return true;
@@ -0,0 +1,38 @@
+/*
+ * eventbus.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: agent
+ */
+
+#include "main.h"
+#include "App/eventbus.h"
+
+static volatile EVENTBUS_mask_t pending_events = 0;
+
+/**
+ * Mark events as pending, safe to call from interrupts and scheduler tasks.
+ */
+void EVENTBUS_post(EVENTBUS_mask_t events){
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	pending_events |= events;
+	__set_PRIMASK(primask);
+}
+
+/**
+ * Return the pending events and clear them.
+ */
+EVENTBUS_mask_t EVENTBUS_take(){
+	EVENTBUS_mask_t events;
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	events = pending_events;
+	pending_events = 0;
+	__set_PRIMASK(primask);
+	return events;
+}
+
+bool EVENTBUS_is_pending(){
+	return pending_events != 0;
+}
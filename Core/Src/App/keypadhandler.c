@@ -9,6 +9,7 @@
 #include "main.h"
 #include "config.h"
 #include "App/keypadhandler.h"
+#include "App/eventbus.h"
 #include "DeviceManager/keypadmanager.h"
 #include "DeviceManager/lcdmanager.h"
 #include "Device/rtc.h"
@@ -582,11 +583,13 @@ static bool KEYPADHANDLER_clear_data(){
 
 static void KEYPADHANDLER_printf(){
 	if(prev_state != state){
+		EVENTBUS_post(EVENT_KEYPADHANDLER);
 		utils_log_info(state_name[state]);
 	}
 }
 
 static void KEYPADHANDLER_timeout(){
 	timeout = true;
+	EVENTBUS_post(EVENT_KEYPADHANDLER);
 }
 
@@ -7,6 +7,11 @@
 
 #include <App/mqtt.h>
 #include "config.h"
+#include "App/eventbus.h"
+#include "App/outbox.h"
+#include "App/reportcodec.h"
+#include "App/msgpool.h"
+#include "Lib/scheduler/scheduler.h"
 #include "Lib/netif/inc/netif.h"
 #include "Lib/utils/utils_buffer.h"
 #include "Lib/utils/utils_logger.h"
@@ -28,14 +33,38 @@ static void on_disconnect_cb(uint8_t status);
 static void on_message_cb(char * topic, char * payload);
 static void on_publish_cb(uint8_t status);
 static uint8_t mqtt_subtopic_to_id(char * topic);
+static uint8_t mqtt_build_batch(MSGPOOL_handle_t * handle, uint32_t first);
+static void mqtt_entry_type(OUTBOX_entry_t * entry, const char ** type, uint8_t * type_len);
+static void mqtt_window_reset();
+static void mqtt_window_resend();
+static void timeout_for_poll();
 
 // Internal State
 static uint8_t mqtt_state = MQTT_WAIT_FOR_INTERNET_CONNECTED;
 
+// QoS 1 publishes sent and not yet acknowledged, in order. The acknowledgements come
+// in the same order and carry no id, so each publish is numbered and each
+// acknowledgement takes the next number. One that matches no publish in the window
+// belongs to a publish a reset forgot, its messages are already taken again
+typedef struct {
+	uint32_t id;
+	uint32_t sent;
+	uint8_t outbox_count;		// Outbox messages carried, marked sent on the acknowledgement
+}MQTT_inflight_t;
+
+static MQTT_inflight_t window[PUBLISH_WINDOW];
+static uint8_t window_head = 0;
+static uint8_t window_len = 0;
+static uint32_t window_outbox_count = 0;		// Outbox messages in flight, the next publish starts after them
+static uint32_t publish_id = 0;					// Number of the next QoS 1 publish
+static uint32_t ack_id = 0;						// Publish the next acknowledgement belongs to
+static uint32_t window_drop_count = 0;			// Outbox drops when the first of them was sent
+static uint32_t retransmit_count = 0;			// Outbox messages sent again after PUBLISH_ACK_TIMEOUT
+
 // Flag for limit time between 2 publish message
 static bool timeout_to_publish_flag = false;
 
-// Tx-Rx Buffer
+// Tx-Rx Buffer, handles of the pool
 static utils_buffer_t mqtt_tx_buffer;
 static utils_buffer_t mqtt_rx_buffer;
 
@@ -46,6 +75,7 @@ static bool have_message = false;
 static bool published = false;
 
 static char client_id[CLIENTID_MAX_LEN];
+static char batch_topic[TOPIC_MAX_LEN];
 
 static char subtopic_entry[][TOPIC_MAX_LEN] = {
 		[SUBTOPIC_CONFIG] = "%s/%s/config",
@@ -77,11 +107,16 @@ void MQTT_init(){
 		snprintf(topic_temp, TOPIC_MAX_LEN, subtopic_entry[var],MODEL ,config->device_id);
 		memcpy(subtopic_entry[var], topic_temp, TOPIC_MAX_LEN);
 	}
+	snprintf(batch_topic, TOPIC_MAX_LEN, "%s/%s/%s", MODEL, config->device_id, BATCH_SUBTOPIC);
     // Init Tx-Rx Buffer;
-    utils_buffer_init(&mqtt_tx_buffer, sizeof(MQTT_message_t));
-    utils_buffer_init(&mqtt_rx_buffer, sizeof(MQTT_message_t));
+    MSGPOOL_init();
+    utils_buffer_init(&mqtt_tx_buffer, sizeof(MSGPOOL_handle_t));
+    utils_buffer_init(&mqtt_rx_buffer, sizeof(MSGPOOL_handle_t));
+    OUTBOX_init();
     // Init netif
     netif_init();
+    // Netif timeouts and the waits between commands are polled
+    SCH_Add_Task_Priority(timeout_for_poll, MQTT_POLL_INTERVAL, MQTT_POLL_INTERVAL, SCH_PRIORITY_UI);
 }
 
 /**
@@ -90,12 +125,17 @@ void MQTT_init(){
  *2. Publish
  */
 void MQTT_run(){
-    static MQTT_message_t publish_message;
+    static MSGPOOL_handle_t publish_handle = MSGPOOL_NONE;
+    MQTT_message_t * publish_message;
+    uint8_t publish_qos;
+    // Outbox messages in publish_handle
+    static uint8_t batch_count = 0;
 	static uint32_t last_sent = 0;
 	static uint8_t subtopic_idx = 0;
 	static uint8_t subtopic_size = sizeof(subtopic_entry) / sizeof(subtopic_entry[0]);
 	bool internet_connected = false;
 	netif_status_t ret;
+	uint8_t prev_state = mqtt_state;
 	netif_run();
 	switch (mqtt_state) {
 		case MQTT_WAIT_FOR_INTERNET_CONNECTED:
@@ -145,6 +185,8 @@ void MQTT_run(){
 				if(subtopic_idx >= subtopic_size){
 					subtopic_idx = 0;
 					mqtt_state = MQTT_CLIENT_IDLE;
+					// The connection type may have changed, and the deltas held while down can go
+					EVENTBUS_post(EVENT_STATUS_CHANGED);
 				}
 				last_sent = NETIF_GET_TIME_MS();
 			}else if(ret != NETIF_IN_PROCESS){
@@ -154,30 +196,64 @@ void MQTT_run(){
 			}
 			break;
         case MQTT_CLIENT_PUBLISH:
-        	if(NETIF_GET_TIME_MS() - last_sent < COMMAND_INTERVAL){
+        	if(NETIF_GET_TIME_MS() - last_sent < PUBLISH_INTERVAL){
 				break;
 			}
-			ret = netif_mqtt_publish(&mqtt_client, publish_message.topic,
-													publish_message.payload,
-													publish_message.qos,
-													publish_message.retain);
+			publish_message = MSGPOOL_get(publish_handle);
+			publish_qos = publish_message->qos;
+			ret = netif_mqtt_publish(&mqtt_client, publish_message->topic,
+													publish_message->payload,
+													publish_message->qos,
+													publish_message->retain);
+			if(ret != NETIF_IN_PROCESS){
+				MSGPOOL_release(publish_handle);
+				publish_handle = MSGPOOL_NONE;
+			}
 			if(ret == NETIF_OK){
 				last_sent = NETIF_GET_TIME_MS();
 				utils_log_info("Mqtt Publish OK\r\n");
+				// Wait for its acknowledgement while the next ones go out. A QoS 0
+				// publish gets none, it is done
+				if(publish_qos > 0){
+					if(window_outbox_count == 0){
+						window_drop_count = OUTBOX_get_drop_count();
+					}
+					window[(window_head + window_len) % PUBLISH_WINDOW].id = publish_id++;
+					window[(window_head + window_len) % PUBLISH_WINDOW].sent = last_sent;
+					window[(window_head + window_len) % PUBLISH_WINDOW].outbox_count = batch_count;
+					window_len++;
+					window_outbox_count += batch_count;
+				}
                 mqtt_state = MQTT_CLIENT_IDLE;
 			}else if(ret  != NETIF_IN_PROCESS){
 				// Restart when not connect to MQTT
+				mqtt_window_reset();
 				mqtt_state = MQTT_RESTART;
 			}
 			break;
 		case MQTT_CLIENT_IDLE:
 			// Check if Mqtt disconnected
             if(!connected){
+            	mqtt_window_reset();
                 mqtt_state = MQTT_CLIENT_CONNECT;
             }
+            // No acknowledgement for the oldest publish: go back to it, the outbox
+            // messages from there are sent again. A status is not, the next one replaces it
+            else if(window_len && NETIF_GET_TIME_MS() - window[window_head].sent > PUBLISH_ACK_TIMEOUT){
+            	utils_log_warn("Mqtt publish not acknowledged, %d sent again\r\n", window_outbox_count);
+            	retransmit_count += window_outbox_count;
+            	mqtt_window_resend();
+            }
+            else if(window_len >= PUBLISH_WINDOW){
+            	break;
+            }
+            // The outbox first, it holds the oldest reports. A failed publish leaves the message there
+            else if((batch_count = mqtt_build_batch(&publish_handle, window_outbox_count)) > 0){
+                mqtt_state = MQTT_CLIENT_PUBLISH;
+            }
             // Check if Mqtt have message to sent
             else if(utils_buffer_is_available(&mqtt_tx_buffer)){
-                utils_buffer_pop(&mqtt_tx_buffer, &publish_message);
+                utils_buffer_pop(&mqtt_tx_buffer, &publish_handle);
                 mqtt_state = MQTT_CLIENT_PUBLISH;
             }
 			break;
@@ -198,31 +274,59 @@ void MQTT_run(){
 		default:
 			break;
 	}
+	// Go on with the next step or the next message without waiting for the poll
+	if(mqtt_state != prev_state
+			|| (mqtt_state == MQTT_CLIENT_IDLE && window_len < PUBLISH_WINDOW
+					&& (utils_buffer_is_available(&mqtt_tx_buffer) || OUTBOX_get_depth() > window_outbox_count))){
+		EVENTBUS_post(EVENT_MQTT);
+	}
 }
 
 bool MQTT_is_ready(){
     return mqtt_state == MQTT_CLIENT_IDLE;
 }
 
-bool MQTT_sent_message(MQTT_message_t * message){
+uint32_t MQTT_get_retransmit_count(){
+	return retransmit_count;
+}
+
+bool MQTT_sent_message(MSGPOOL_handle_t handle){
+	MQTT_message_t * message = MSGPOOL_get(handle);
+	if(message == NULL){
+		utils_log_warn("Mqtt message pool is empty\r\n");
+		return false;
+	}
+    if(message->persistent){
+    	// The outbox keeps its own copy in flash
+    	OUTBOX_push(message);
+    	MSGPOOL_release(handle);
+    	EVENTBUS_post(EVENT_MQTT);
+    	return true;
+    }
     if(utils_buffer_is_full(&mqtt_tx_buffer)){
     	utils_log_warn("Mqtt message buffer is full\r\n");
+    	MSGPOOL_release(handle);
         return false;
     }
-    utils_buffer_push(&mqtt_tx_buffer,message);
+    utils_buffer_push(&mqtt_tx_buffer, &handle);
+    EVENTBUS_post(EVENT_MQTT);
     return true;
 }
 
-bool MQTT_receive_message(MQTT_message_t * message){
+bool MQTT_receive_message(MSGPOOL_handle_t * handle){
     if(!utils_buffer_is_available(&mqtt_rx_buffer)){
         return false;
     }
-    utils_buffer_pop(&mqtt_rx_buffer,message);
+    utils_buffer_pop(&mqtt_rx_buffer, handle);
     return true;
 }
 
 bool mqtt_receive_message_drop_all(){
-	utils_buffer_drop_all(&mqtt_rx_buffer);
+	MSGPOOL_handle_t handle;
+	while(utils_buffer_is_available(&mqtt_rx_buffer)){
+		utils_buffer_pop(&mqtt_rx_buffer, &handle);
+		MSGPOOL_release(handle);
+	}
 }
 
 
@@ -244,14 +348,174 @@ static void on_disconnect_cb(uint8_t status){
 
 static void on_message_cb(char * topic, char * payload){
 	utils_log_debug("On message callback: topic %s, payload %s\r\n", topic,payload);
-    MQTT_message_t message = {0};
-    message.topic_id = mqtt_subtopic_to_id(topic);
-    memcpy(message.payload, payload , strlen(payload));
-	utils_buffer_push(&mqtt_rx_buffer, &message);
+	MSGPOOL_handle_t handle;
+	MQTT_message_t * message;
+	if(utils_buffer_is_full(&mqtt_rx_buffer) || (handle = MSGPOOL_alloc()) == MSGPOOL_NONE){
+		utils_log_warn("Mqtt message dropped, no room\r\n");
+		return;
+	}
+	message = MSGPOOL_get(handle);
+	message->topic_id = mqtt_subtopic_to_id(topic);
+	strncpy(message->payload, payload, PAYLOAD_MAX_LEN - 1);
+	message->payload[PAYLOAD_MAX_LEN - 1] = '\0';
+	utils_buffer_push(&mqtt_rx_buffer, &handle);
+	EVENTBUS_post(EVENT_COMMAND);
 }
 
 static void on_publish_cb(uint8_t status){
+	MQTT_inflight_t * inflight = &window[window_head];
+	uint32_t id = ack_id;
 	utils_log_debug("On publish callback\r\n");
+	if(id == publish_id){
+		// Nothing waits for one
+		return;
+	}
+	ack_id++;
+	if(window_len == 0 || id != inflight->id){
+		utils_log_debug("Mqtt stale acknowledgement ignored\r\n");
+		return;
+	}
+	if(status != NETIF_OK){
+		// Its messages and the ones after go out again
+		utils_log_warn("Mqtt publish failed, %d sent again\r\n", window_outbox_count);
+		retransmit_count += window_outbox_count;
+		mqtt_window_resend();
+		EVENTBUS_post(EVENT_MQTT);
+		return;
+	}
+	if(OUTBOX_get_drop_count() != window_drop_count){
+		// Pages dropped under the messages in flight, send from the oldest left rather than lose any
+		for (int var = 0; var < window_len; ++var) {
+			window[(window_head + var) % PUBLISH_WINDOW].outbox_count = 0;
+		}
+		window_outbox_count = 0;
+	}
+	for (int var = 0; var < inflight->outbox_count; ++var) {
+		OUTBOX_pop();
+	}
+	window_outbox_count -= inflight->outbox_count;
+	window_head = (window_head + 1) % PUBLISH_WINDOW;
+	window_len--;
+	EVENTBUS_post(EVENT_MQTT);
+}
+
+/**
+ * The connection is lost: forget the publishes in flight, their outbox messages are
+ * taken again from the oldest. A new connection acknowledges only its own publishes
+ */
+static void mqtt_window_reset(){
+	window_head = 0;
+	window_len = 0;
+	window_outbox_count = 0;
+	ack_id = publish_id;
+}
+
+/**
+ * Send the publishes in flight again on the same connection. Their acknowledgements
+ * may still come, they are skipped by their number. The ones owed for older publishes
+ * are given up, they are more than PUBLISH_ACK_TIMEOUT late
+ */
+static void mqtt_window_resend(){
+	if(window_len && (int32_t)(ack_id - window[window_head].id) < 0){
+		ack_id = window[window_head].id;
+	}
+	window_head = 0;
+	window_len = 0;
+	window_outbox_count = 0;
+}
+
+static void timeout_for_poll(){
+	EVENTBUS_post(EVENT_MQTT);
+}
+
+/**
+ * The oldest outbox messages from first that fit in one payload, as a JSON array on the
+ * batch topic, in a slot of the pool. A message alone goes out as it is. The messages
+ * are read in place in the flash, each one is copied once, into the slot.
+ * Returns the number of messages taken, handle is set only when it is not 0
+ */
+static uint8_t mqtt_build_batch(MSGPOOL_handle_t * handle, uint32_t first){
+	OUTBOX_entry_t start;
+	OUTBOX_entry_t entry;
+	MQTT_message_t * message;
+	MSGPOOL_handle_t slot;
+	const char * type;
+	uint8_t type_len;
+	bool binary;
+	size_t len;
+	size_t entry_len;
+	uint8_t count = 0;
+	if(!OUTBOX_find(first, &start) || (slot = MSGPOOL_alloc()) == MSGPOOL_NONE){
+		return 0;
+	}
+	message = MSGPOOL_get(slot);
+	// Binary frames carry their report, they go comma separated without brackets.
+	// The batch stops where the format changes. Only the lengths first, so that a
+	// message alone is not built twice
+	binary = !start.payload_len || REPORTCODEC_is_binary(start.payload);
+	len = binary ? 0 : 1;
+	entry = start;
+	do{
+		if(count && (!entry.payload_len || REPORTCODEC_is_binary(entry.payload)) != binary){
+			break;
+		}
+		mqtt_entry_type(&entry, &type, &type_len);
+		entry_len = (count ? 1 : 0) + entry.payload_len + (binary ? 0 : sizeof("{\"rp\":\"\",\"d\":}") - 1 + type_len);
+		// Room for the closing bracket
+		if(len + entry_len + 1 >= PAYLOAD_MAX_LEN){
+			break;
+		}
+		len += entry_len;
+		count++;
+	}while(count < UINT8_MAX && OUTBOX_next(&entry));
+	if(count < 2){
+		memcpy(message->topic, start.topic, start.topic_len);
+		message->topic[start.topic_len] = '\0';
+		memcpy(message->payload, start.payload, start.payload_len);
+		message->payload[start.payload_len] = '\0';
+		message->retain = start.retain;
+		count = 1;
+	}else{
+		entry = start;
+		len = 0;
+		if(!binary){
+			message->payload[len++] = '[';
+		}
+		for (int var = 0; var < count; ++var) {
+			if(binary){
+				len += snprintf(message->payload + len, PAYLOAD_MAX_LEN - len, "%s%.*s",
+						var ? "," : "", entry.payload_len, entry.payload);
+			}else{
+				mqtt_entry_type(&entry, &type, &type_len);
+				len += snprintf(message->payload + len, PAYLOAD_MAX_LEN - len, "%s{\"rp\":\"%.*s\",\"d\":%.*s}",
+						var ? "," : "", type_len, type, entry.payload_len, entry.payload);
+			}
+			OUTBOX_next(&entry);
+		}
+		if(!binary){
+			message->payload[len++] = ']';
+		}
+		message->payload[len] = '\0';
+		snprintf(message->topic, TOPIC_MAX_LEN, "%s", batch_topic);
+		message->retain = 0;
+	}
+	// Outbox messages leave the outbox on their acknowledgement
+	message->qos = 1;
+	message->persistent = 1;
+	*handle = slot;
+	return count;
+}
+
+/**
+ * Report name from the topic: rp/bill_accepted -> bill_accepted
+ */
+static void mqtt_entry_type(OUTBOX_entry_t * entry, const char ** type, uint8_t * type_len){
+	uint8_t start = entry->topic_len;
+	while(start > 0 && entry->topic[start - 1] != '/'){
+		start--;
+	}
+	*type = entry->topic + start;
+	*type_len = entry->topic_len - start;
 }
 
 static uint8_t mqtt_subtopic_to_id(char * topic){
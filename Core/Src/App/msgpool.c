@@ -0,0 +1,93 @@
+/*
+ * msgpool.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: agent
+ */
+
+#include "main.h"
+#include "string.h"
+#include "App/msgpool.h"
+
+static MQTT_message_t slots[MSGPOOL_SIZE];
+static bool in_use[MSGPOOL_SIZE];
+static MSGPOOL_stats_t stats;
+
+static MSGPOOL_handle_t MSGPOOL_take(uint32_t keep);
+
+void MSGPOOL_init(){
+	memset(in_use, 0, sizeof(in_use));
+	memset(&stats, 0, sizeof(stats));
+}
+
+/**
+ * Free slot, the header fields and the strings cleared.
+ * MSGPOOL_NONE when only the reserved slots are left
+ */
+MSGPOOL_handle_t MSGPOOL_alloc(){
+	return MSGPOOL_take(MSGPOOL_RESERVED);
+}
+
+/**
+ * Same, the reserved slots included. For the messages released before the caller
+ * returns, the ones copied to the outbox
+ */
+MSGPOOL_handle_t MSGPOOL_alloc_reserved(){
+	return MSGPOOL_take(0);
+}
+
+MQTT_message_t * MSGPOOL_get(MSGPOOL_handle_t handle){
+	if(handle >= MSGPOOL_SIZE){
+		return NULL;
+	}
+	return &slots[handle];
+}
+
+void MSGPOOL_release(MSGPOOL_handle_t handle){
+	uint32_t primask;
+	if(handle >= MSGPOOL_SIZE){
+		return;
+	}
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if(in_use[handle]){
+		in_use[handle] = false;
+		stats.used--;
+	}
+	__set_PRIMASK(primask);
+}
+
+void MSGPOOL_get_stats(MSGPOOL_stats_t * stats_out){
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	memcpy(stats_out, &stats, sizeof(MSGPOOL_stats_t));
+	__set_PRIMASK(primask);
+}
+
+static MSGPOOL_handle_t MSGPOOL_take(uint32_t keep){
+	MSGPOOL_handle_t handle = MSGPOOL_NONE;
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	for (uint8_t var = 0; var < MSGPOOL_SIZE && stats.used + keep < MSGPOOL_SIZE; ++var) {
+		if(!in_use[var]){
+			in_use[var] = true;
+			handle = var;
+			break;
+		}
+	}
+	if(handle == MSGPOOL_NONE){
+		stats.fail_count++;
+	}else if(++stats.used > stats.peak){
+		stats.peak = stats.used;
+	}
+	__set_PRIMASK(primask);
+	if(handle != MSGPOOL_NONE){
+		slots[handle].topic_id = 0;
+		slots[handle].topic[0] = '\0';
+		slots[handle].payload[0] = '\0';
+		slots[handle].qos = 0;
+		slots[handle].retain = 0;
+		slots[handle].persistent = 0;
+	}
+	return handle;
+}
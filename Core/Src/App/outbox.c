@@ -0,0 +1,335 @@
+/*
+ * outbox.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: agent
+ */
+
+
+#include "main.h"
+#include "stddef.h"
+#include "string.h"
+#include "App/outbox.h"
+#include "Device/rtc.h"
+#include "Hal/flash.h"
+#include "Lib/utils/utils_logger.h"
+
+// Append-only log over the flash pages, used as a ring. A page is erased when the
+// writer enters it, each page starts with its number so that the oldest is found at boot.
+// Flash bits only go from 1 to 0: a record is committed, then marked sent, by
+// programming a halfword to 0
+#define OUTBOX_PAGE_SIZE		FLASH_PAGE_SIZE
+#define OUTBOX_MAGIC			0x0B0C
+#define OUTBOX_EMPTY			0xFFFF
+#define OUTBOX_MARK				0x0000
+#define OUTBOX_RECORD_MAX_LEN	(TOPIC_MAX_LEN + PAYLOAD_MAX_LEN)
+
+typedef struct {
+	uint32_t seq;
+	uint16_t magic;
+	uint16_t reserved;
+}OUTBOX_page_t;
+
+typedef struct {
+	uint16_t len;				// Topic and payload bytes after the header, OUTBOX_EMPTY past the last record
+	uint8_t topic_len;
+	uint8_t qos;
+	uint8_t retain;
+	uint8_t reserved;
+	uint16_t committed;			// OUTBOX_MARK once the whole record is written
+	uint32_t time;				// RTC seconds since 2000 when queued
+	uint16_t sent;				// OUTBOX_MARK once published
+	uint16_t reserved2;
+}OUTBOX_record_t;
+
+typedef struct {
+	uint8_t page;
+	uint16_t offset;
+}OUTBOX_cursor_t;
+
+static OUTBOX_cursor_t write_cursor;
+static OUTBOX_cursor_t read_cursor;			// Oldest unsent record, the write cursor when there is none
+static uint32_t page_seq = 0;				// Number of the page being written
+static uint32_t depth = 0;
+static uint32_t drop_count = 0;
+// Record staged in RAM, programmed a halfword at a time
+static uint8_t stage_buf[sizeof(OUTBOX_record_t) + OUTBOX_RECORD_MAX_LEN + 1];
+
+static OUTBOX_record_t * OUTBOX_record_at(OUTBOX_cursor_t * cursor);
+static void OUTBOX_seek(OUTBOX_cursor_t cursor);
+static void OUTBOX_next_page();
+static void OUTBOX_start_page(uint8_t page);
+static bool OUTBOX_is_end(OUTBOX_record_t * record, uint16_t offset);
+static bool OUTBOX_is_unsent(OUTBOX_record_t * record);
+static uint16_t OUTBOX_record_size(OUTBOX_record_t * record);
+static bool OUTBOX_entry_set(OUTBOX_entry_t * entry, OUTBOX_cursor_t * cursor, OUTBOX_record_t * record);
+static uint32_t OUTBOX_page_address(uint8_t page);
+static uint32_t OUTBOX_now();
+
+/**
+ * Find the page written last and the oldest unsent record
+ */
+bool OUTBOX_init(){
+	OUTBOX_page_t * page;
+	OUTBOX_record_t * record;
+	OUTBOX_cursor_t cursor;
+	uint8_t oldest_page = 0;
+	uint32_t oldest_seq = 0;
+	bool found = false;
+	for (uint8_t var = 0; var < OUTBOX_PAGES; ++var) {
+		page = (OUTBOX_page_t *)OUTBOX_page_address(var);
+		if(page->magic != OUTBOX_MAGIC){
+			continue;
+		}
+		if(!found || (int32_t)(page->seq - page_seq) > 0){
+			page_seq = page->seq;
+			write_cursor.page = var;
+		}
+		if(!found || (int32_t)(page->seq - oldest_seq) < 0){
+			oldest_seq = page->seq;
+			oldest_page = var;
+		}
+		found = true;
+	}
+	if(!found){
+		OUTBOX_start_page(0);
+		read_cursor = write_cursor;
+		utils_log_info("OUTBOX init: empty\r\n");
+		return true;
+	}
+	// End of the records in the last page, a torn one still has its length
+	write_cursor.offset = sizeof(OUTBOX_page_t);
+	while(write_cursor.offset + sizeof(OUTBOX_record_t) <= OUTBOX_PAGE_SIZE){
+		record = (OUTBOX_record_t *)(OUTBOX_page_address(write_cursor.page) + write_cursor.offset);
+		if(OUTBOX_is_end(record, write_cursor.offset)){
+			break;
+		}
+		write_cursor.offset += OUTBOX_record_size(record);
+	}
+	cursor.page = oldest_page;
+	cursor.offset = sizeof(OUTBOX_page_t);
+	while((record = OUTBOX_record_at(&cursor)) != NULL){
+		if(OUTBOX_is_unsent(record)){
+			depth++;
+		}
+		cursor.offset += OUTBOX_record_size(record);
+	}
+	cursor.page = oldest_page;
+	cursor.offset = sizeof(OUTBOX_page_t);
+	OUTBOX_seek(cursor);
+	utils_log_info("OUTBOX init: %d waiting\r\n", depth);
+	return true;
+}
+
+/**
+ * Write the message to flash, erasing the oldest page when the outbox is full
+ */
+bool OUTBOX_push(MQTT_message_t * message){
+	OUTBOX_record_t * record = (OUTBOX_record_t *)stage_buf;
+	uint32_t address;
+	uint16_t size;
+	size_t topic_len = strnlen(message->topic, TOPIC_MAX_LEN - 1);
+	size_t payload_len = strnlen(message->payload, PAYLOAD_MAX_LEN - 1);
+	memset(stage_buf, 0xFF, sizeof(stage_buf));
+	record->len = topic_len + payload_len;
+	record->topic_len = topic_len;
+	record->qos = message->qos;
+	record->retain = message->retain;
+	record->time = OUTBOX_now();
+	memcpy(stage_buf + sizeof(OUTBOX_record_t), message->topic, topic_len);
+	memcpy(stage_buf + sizeof(OUTBOX_record_t) + topic_len, message->payload, payload_len);
+	size = OUTBOX_record_size(record);
+	if(write_cursor.offset + size > OUTBOX_PAGE_SIZE){
+		OUTBOX_next_page();
+	}
+	address = OUTBOX_page_address(write_cursor.page) + write_cursor.offset;
+	FLASH_write_buf(address, stage_buf, size);
+	FLASH_write_int(address + offsetof(OUTBOX_record_t, committed), OUTBOX_MARK);
+	if(depth == 0){
+		read_cursor = write_cursor;
+	}
+	write_cursor.offset += size;
+	depth++;
+	return true;
+}
+
+/**
+ * Unsent message where it is in the flash, index 0 is the oldest. It stays in the
+ * outbox until OUTBOX_pop, the entry is valid until the next push or pop
+ */
+bool OUTBOX_find(uint32_t index, OUTBOX_entry_t * entry){
+	OUTBOX_record_t * record;
+	OUTBOX_cursor_t cursor = read_cursor;
+	if(index >= depth){
+		return false;
+	}
+	while((record = OUTBOX_record_at(&cursor)) != NULL && (!OUTBOX_is_unsent(record) || index-- > 0)){
+		cursor.offset += OUTBOX_record_size(record);
+	}
+	return OUTBOX_entry_set(entry, &cursor, record);
+}
+
+/**
+ * Move the entry to the unsent message after it
+ */
+bool OUTBOX_next(OUTBOX_entry_t * entry){
+	OUTBOX_record_t * record;
+	OUTBOX_cursor_t cursor = {.page = entry->page, .offset = entry->offset};
+	if((record = OUTBOX_record_at(&cursor)) == NULL){
+		return false;
+	}
+	cursor.offset += OUTBOX_record_size(record);
+	while((record = OUTBOX_record_at(&cursor)) != NULL && !OUTBOX_is_unsent(record)){
+		cursor.offset += OUTBOX_record_size(record);
+	}
+	return OUTBOX_entry_set(entry, &cursor, record);
+}
+
+/**
+ * The oldest message is published, mark it sent
+ */
+void OUTBOX_pop(){
+	OUTBOX_record_t * record;
+	if(depth == 0){
+		return;
+	}
+	record = (OUTBOX_record_t *)(OUTBOX_page_address(read_cursor.page) + read_cursor.offset);
+	FLASH_write_int((uint32_t)&record->sent, OUTBOX_MARK);
+	depth--;
+	read_cursor.offset += OUTBOX_record_size(record);
+	OUTBOX_seek(read_cursor);
+}
+
+uint32_t OUTBOX_get_depth(){
+	return depth;
+}
+
+uint32_t OUTBOX_get_drop_count(){
+	return drop_count;
+}
+
+void OUTBOX_get_stats(OUTBOX_stats_t * stats){
+	OUTBOX_record_t * record;
+	uint32_t now;
+	stats->depth = depth;
+	stats->drop_count = drop_count;
+	stats->oldest_age = 0;
+	if(depth > 0){
+		record = (OUTBOX_record_t *)(OUTBOX_page_address(read_cursor.page) + read_cursor.offset);
+		now = OUTBOX_now();
+		stats->oldest_age = now > record->time ? now - record->time : 0;
+	}
+}
+
+/**
+ * Record at the cursor, moving it to the next page at the end of one. NULL at the write cursor
+ */
+static OUTBOX_record_t * OUTBOX_record_at(OUTBOX_cursor_t * cursor){
+	OUTBOX_record_t * record;
+	while(cursor->page != write_cursor.page || cursor->offset < write_cursor.offset){
+		record = (OUTBOX_record_t *)(OUTBOX_page_address(cursor->page) + cursor->offset);
+		if(cursor->offset + sizeof(OUTBOX_record_t) <= OUTBOX_PAGE_SIZE && !OUTBOX_is_end(record, cursor->offset)){
+			return record;
+		}
+		cursor->page = (cursor->page + 1) % OUTBOX_PAGES;
+		cursor->offset = sizeof(OUTBOX_page_t);
+	}
+	return NULL;
+}
+
+/**
+ * Move the read cursor to the first unsent record from the cursor given
+ */
+static void OUTBOX_seek(OUTBOX_cursor_t cursor){
+	OUTBOX_record_t * record;
+	while((record = OUTBOX_record_at(&cursor)) != NULL && !OUTBOX_is_unsent(record)){
+		cursor.offset += OUTBOX_record_size(record);
+	}
+	read_cursor = cursor;
+}
+
+/**
+ * Continue in the next page. When it still holds unsent records the outbox is
+ * full, they are dropped: the newer reports carry the current counters
+ */
+static void OUTBOX_next_page(){
+	uint8_t page = (write_cursor.page + 1) % OUTBOX_PAGES;
+	OUTBOX_record_t * record;
+	OUTBOX_cursor_t cursor = read_cursor;
+	if(depth > 0 && read_cursor.page == page){
+		while((record = OUTBOX_record_at(&cursor)) != NULL && cursor.page == page){
+			if(OUTBOX_is_unsent(record)){
+				depth--;
+				drop_count++;
+			}
+			cursor.offset += OUTBOX_record_size(record);
+		}
+		OUTBOX_seek(cursor);
+		utils_log_warn("OUTBOX full, oldest page dropped\r\n");
+	}
+	page_seq++;
+	OUTBOX_start_page(page);
+}
+
+static void OUTBOX_start_page(uint8_t page){
+	OUTBOX_page_t header = {
+		.seq = page_seq,
+		.magic = OUTBOX_MAGIC,
+		.reserved = 0xFFFF
+	};
+	FLASH_erase(OUTBOX_page_address(page), sizeof(OUTBOX_page_t));
+	FLASH_write_buf(OUTBOX_page_address(page), (uint8_t *)&header, sizeof(OUTBOX_page_t));
+	write_cursor.page = page;
+	write_cursor.offset = sizeof(OUTBOX_page_t);
+}
+
+// Past the last record of the page. The length is programmed first, a torn record is skipped with it
+static bool OUTBOX_is_end(OUTBOX_record_t * record, uint16_t offset){
+	return record->len == OUTBOX_EMPTY || offset + OUTBOX_record_size(record) > OUTBOX_PAGE_SIZE;
+}
+
+static bool OUTBOX_is_unsent(OUTBOX_record_t * record){
+	return record->committed == OUTBOX_MARK && record->sent != OUTBOX_MARK
+			&& record->topic_len < TOPIC_MAX_LEN
+			&& record->len >= record->topic_len
+			&& record->len - record->topic_len < PAYLOAD_MAX_LEN;
+}
+
+static bool OUTBOX_entry_set(OUTBOX_entry_t * entry, OUTBOX_cursor_t * cursor, OUTBOX_record_t * record){
+	const char * data;
+	if(record == NULL){
+		return false;
+	}
+	data = (const char *)record + sizeof(OUTBOX_record_t);
+	entry->topic = data;
+	entry->topic_len = record->topic_len;
+	entry->payload = data + record->topic_len;
+	entry->payload_len = record->len - record->topic_len;
+	entry->qos = record->qos;
+	entry->retain = record->retain;
+	entry->page = cursor->page;
+	entry->offset = cursor->offset;
+	return true;
+}
+
+// Header and data, halfword aligned
+static uint16_t OUTBOX_record_size(OUTBOX_record_t * record){
+	return sizeof(OUTBOX_record_t) + ((record->len + 1) & ~1);
+}
+
+static uint32_t OUTBOX_page_address(uint8_t page){
+	return OUTBOX_ADDRESS + page * OUTBOX_PAGE_SIZE;
+}
+
+// RTC time in seconds since 2000
+static uint32_t OUTBOX_now(){
+	static const uint16_t days_before_month[] = {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+	RTC_t rtc = RTC_get_time();
+	uint32_t year = rtc.year >= 2000 ? rtc.year - 2000 : 0;
+	uint8_t month = (rtc.month >= 1 && rtc.month <= 12) ? rtc.month - 1 : 0;
+	uint32_t days = year * 365 + (year + 3) / 4 + days_before_month[month] + (rtc.date ? rtc.date - 1 : 0);
+	if(month >= 2 && year % 4 == 0){
+		days++;
+	}
+	return ((days * 24 + rtc.hour) * 60 + rtc.minute) * 60 + rtc.second;
+}
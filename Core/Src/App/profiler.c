@@ -0,0 +1,235 @@
+/*
+ * profiler.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: agent
+ */
+
+#include "main.h"
+#include "string.h"
+#include "App/profiler.h"
+#include "Lib/scheduler/scheduler.h"
+#include "Lib/utils/utils_logger.h"
+
+typedef struct {
+	void (* task)(void);
+	PROFILER_entry_t entry;
+}PROFILER_task_t;
+
+static const char * module_name[PROFILER_MODULE_MAX] = {
+		[PROFILER_MQTT] = "MQTT",
+		[PROFILER_STATUSREPORTER] = "STATUSREPORTER",
+		[PROFILER_COMMANDHANDLER] = "COMMANDHANDLER",
+		[PROFILER_BILLACCEPTORMNG] = "BILLACCEPTORMNG",
+		[PROFILER_LCDMNG] = "LCDMNG",
+		[PROFILER_KEYPADMNG] = "KEYPADMNG",
+		[PROFILER_KEYPADHANDLER] = "KEYPADHANDLER",
+		[PROFILER_TCDMNG] = "TCDMNG",
+		[PROFILER_SCHEDULER] = "SCHEDULER",
+		[PROFILER_STATE] = "STATE",
+};
+
+static PROFILER_entry_t module_table[PROFILER_MODULE_MAX];
+static PROFILER_task_t task_table[PROFILER_TASK_MAX];
+static size_t task_table_len = 0;
+// Main loop period, the cycle counter stops while the core sleeps in WFI
+static PROFILER_entry_t loop_entry;
+static bool loop_started = false;
+static uint32_t loop_last = 0;
+static uint32_t loop_prev_period = 0;
+static uint32_t loop_jitter_max = 0;
+static uint64_t loop_jitter_total = 0;
+static uint32_t cycles_per_us = 1;
+
+static void PROFILER_record(PROFILER_entry_t * entry, uint32_t cycles);
+static void PROFILER_clear(PROFILER_entry_t * entry);
+static void PROFILER_run_task(void (* task)(void));
+static void PROFILER_print(const char * name, PROFILER_entry_t * entry);
+static uint32_t PROFILER_avg_us(PROFILER_entry_t * entry);
+
+void PROFILER_init(){
+#if PROFILER_ENABLE
+	cycles_per_us = SystemCoreClock / 1000000;
+	// Enable the DWT cycle counter, not cleared: the I2C timeouts already count from it
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	PROFILER_reset();
+	SCH_Set_Run_Hook(PROFILER_run_task);
+#endif
+}
+
+uint32_t PROFILER_start(){
+	return DWT->CYCCNT;
+}
+
+void PROFILER_stop(uint8_t module, uint32_t start){
+	if(module >= PROFILER_MODULE_MAX){
+		return;
+	}
+	PROFILER_record(&module_table[module], DWT->CYCCNT - start);
+}
+
+/**
+ * Call once per main loop pass, records the loop period and its jitter
+ * (difference between two consecutive periods).
+ */
+void PROFILER_loop(){
+#if PROFILER_ENABLE
+	uint32_t now = DWT->CYCCNT;
+	uint32_t period = now - loop_last;
+	uint32_t jitter;
+	loop_last = now;
+	if(!loop_started){
+		// First call, no period yet
+		loop_started = true;
+		return;
+	}
+	PROFILER_record(&loop_entry, period);
+	if(loop_prev_period == 0){
+		loop_prev_period = period;
+	}
+	jitter = period > loop_prev_period ? period - loop_prev_period : loop_prev_period - period;
+	loop_prev_period = period;
+	loop_jitter_total += jitter;
+	if(jitter > loop_jitter_max){
+		loop_jitter_max = jitter;
+	}
+#endif
+}
+
+void PROFILER_reset(){
+	for (int var = 0; var < PROFILER_MODULE_MAX; ++var) {
+		PROFILER_clear(&module_table[var]);
+	}
+	task_table_len = 0;
+	PROFILER_clear(&loop_entry);
+	loop_prev_period = 0;
+	loop_jitter_max = 0;
+	loop_jitter_total = 0;
+}
+
+void PROFILER_dump(){
+	char name[16];
+	utils_log_info("PROFILER: name count min/avg/max(us) hist(<10us,<100us,<1ms,<10ms,<100ms,>=100ms)\r\n");
+	PROFILER_print("LOOP", &loop_entry);
+	utils_log_info("PROFILER: LOOP jitter avg %dus max %dus\r\n",
+			loop_entry.count ? (uint32_t)(loop_jitter_total / loop_entry.count) / cycles_per_us : 0,
+			loop_jitter_max / cycles_per_us);
+	for (int var = 0; var < PROFILER_MODULE_MAX; ++var) {
+		PROFILER_print(module_name[var], &module_table[var]);
+	}
+	for (int var = 0; var < task_table_len; ++var) {
+		// Tasks are named by address, look them up in the map file
+		snprintf(name, sizeof(name), "TASK_%08x", (uint32_t)task_table[var].task);
+		PROFILER_print(name, &task_table[var].entry);
+	}
+	utils_log_info("PROFILER: SCHEDULER starvation device %d ui %d missed %d overflow %d\r\n",
+			SCH_Get_Starvation_Count(SCH_PRIORITY_DEVICE),
+			SCH_Get_Starvation_Count(SCH_PRIORITY_UI),
+			SCH_Get_Missed_Count(),
+			SCH_Get_Overflow_Count());
+}
+
+/**
+ * Compact metrics for MQTT:
+ * {"l":[avg,max,jitter],"a":[module avg...],"x":[module max...],"t":["addr",max]}
+ * all times in us, "t" is the slowest scheduled task.
+ */
+size_t PROFILER_build_metrics(char * buf, size_t buf_len){
+	size_t len;
+	PROFILER_task_t * slowest = NULL;
+	len = snprintf(buf, buf_len, "{\"l\":[%d,%d,%d],\"a\":[",
+			PROFILER_avg_us(&loop_entry),
+			loop_entry.max / cycles_per_us,
+			loop_jitter_max / cycles_per_us);
+	for (int var = 0; var < PROFILER_MODULE_MAX && len < buf_len; ++var) {
+		len += snprintf(buf + len, buf_len - len, var ? ",%d" : "%d", PROFILER_avg_us(&module_table[var]));
+	}
+	if(len < buf_len){
+		len += snprintf(buf + len, buf_len - len, "],\"x\":[");
+	}
+	for (int var = 0; var < PROFILER_MODULE_MAX && len < buf_len; ++var) {
+		len += snprintf(buf + len, buf_len - len, var ? ",%d" : "%d", module_table[var].max / cycles_per_us);
+	}
+	for (int var = 0; var < task_table_len; ++var) {
+		if(slowest == NULL || task_table[var].entry.max > slowest->entry.max){
+			slowest = &task_table[var];
+		}
+	}
+	if(len < buf_len){
+		if(slowest){
+			len += snprintf(buf + len, buf_len - len, "],\"t\":[\"%08x\",%d]}",
+					(uint32_t)slowest->task,
+					slowest->entry.max / cycles_per_us);
+		}else{
+			len += snprintf(buf + len, buf_len - len, "]}");
+		}
+	}
+	return len < buf_len ? len : buf_len - 1;
+}
+
+static void PROFILER_run_task(void (* task)(void)){
+	PROFILER_task_t * profiler_task = NULL;
+	uint32_t start;
+	for (int var = 0; var < task_table_len; ++var) {
+		if(task_table[var].task == task){
+			profiler_task = &task_table[var];
+			break;
+		}
+	}
+	if(profiler_task == NULL && task_table_len < PROFILER_TASK_MAX){
+		profiler_task = &task_table[task_table_len++];
+		profiler_task->task = task;
+		PROFILER_clear(&profiler_task->entry);
+	}
+	start = DWT->CYCCNT;
+	task();
+	if(profiler_task){
+		PROFILER_record(&profiler_task->entry, DWT->CYCCNT - start);
+	}
+}
+
+static void PROFILER_record(PROFILER_entry_t * entry, uint32_t cycles){
+	uint32_t us = cycles / cycles_per_us;
+	uint8_t bucket = 0;
+	uint32_t limit = 10;
+	entry->count++;
+	entry->total += cycles;
+	if(cycles < entry->min){
+		entry->min = cycles;
+	}
+	if(cycles > entry->max){
+		entry->max = cycles;
+	}
+	while(bucket < PROFILER_HIST_SIZE - 1 && us >= limit){
+		bucket++;
+		limit *= 10;
+	}
+	entry->hist[bucket]++;
+}
+
+static void PROFILER_clear(PROFILER_entry_t * entry){
+	memset(entry, 0, sizeof(PROFILER_entry_t));
+	entry->min = 0xFFFFFFFF;
+}
+
+static void PROFILER_print(const char * name, PROFILER_entry_t * entry){
+	if(entry->count == 0){
+		return;
+	}
+	utils_log_info("PROFILER: %s %d %d/%d/%d [%d,%d,%d,%d,%d,%d]\r\n",
+			name,
+			entry->count,
+			entry->min / cycles_per_us,
+			PROFILER_avg_us(entry),
+			entry->max / cycles_per_us,
+			entry->hist[0], entry->hist[1], entry->hist[2],
+			entry->hist[3], entry->hist[4], entry->hist[5]);
+}
+
+static uint32_t PROFILER_avg_us(PROFILER_entry_t * entry){
+	if(entry->count == 0){
+		return 0;
+	}
+	return (uint32_t)(entry->total / entry->count) / cycles_per_us;
+}
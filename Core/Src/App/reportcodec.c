@@ -0,0 +1,93 @@
+/*
+ * reportcodec.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: agent
+ */
+
+
+#include "string.h"
+#include "App/reportcodec.h"
+
+static const char base64_table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static void REPORTCODEC_put(REPORTCODEC_t * codec, uint8_t data);
+static void REPORTCODEC_varint(REPORTCODEC_t * codec, uint32_t value);
+
+void REPORTCODEC_begin(REPORTCODEC_t * codec, uint8_t report){
+	codec->len = 0;
+	codec->overflow = false;
+	REPORTCODEC_put(codec, (REPORTCODEC_VERSION << 4) | report);
+}
+
+void REPORTCODEC_uint(REPORTCODEC_t * codec, uint8_t field, uint32_t value){
+	REPORTCODEC_put(codec, (REPORTCODEC_UINT << 6) | field);
+	REPORTCODEC_varint(codec, value);
+}
+
+void REPORTCODEC_string(REPORTCODEC_t * codec, uint8_t field, const char * value, size_t max_len){
+	size_t len = strnlen(value, max_len);
+	REPORTCODEC_put(codec, (REPORTCODEC_STRING << 6) | field);
+	REPORTCODEC_varint(codec, len);
+	for (size_t var = 0; var < len; ++var) {
+		REPORTCODEC_put(codec, value[var]);
+	}
+}
+
+void REPORTCODEC_array(REPORTCODEC_t * codec, uint8_t field, const uint32_t * values, uint8_t count){
+	REPORTCODEC_put(codec, (REPORTCODEC_ARRAY << 6) | field);
+	REPORTCODEC_varint(codec, count);
+	for (uint8_t var = 0; var < count; ++var) {
+		REPORTCODEC_varint(codec, values[var]);
+	}
+}
+
+/**
+ * Frame in base64 with its padding, false when it did not fit
+ */
+bool REPORTCODEC_end(REPORTCODEC_t * codec, char * out, size_t out_size){
+	size_t out_len = 0;
+	uint32_t triple;
+	if(codec->overflow || (codec->len + 2) / 3 * 4 + 1 > out_size){
+		out[0] = '\0';
+		return false;
+	}
+	for (size_t var = 0; var < codec->len; var += 3) {
+		triple = (uint32_t)codec->buf[var] << 16;
+		if(var + 1 < codec->len){
+			triple |= (uint32_t)codec->buf[var + 1] << 8;
+		}
+		if(var + 2 < codec->len){
+			triple |= codec->buf[var + 2];
+		}
+		out[out_len++] = base64_table[(triple >> 18) & 0x3F];
+		out[out_len++] = base64_table[(triple >> 12) & 0x3F];
+		out[out_len++] = var + 1 < codec->len ? base64_table[(triple >> 6) & 0x3F] : '=';
+		out[out_len++] = var + 2 < codec->len ? base64_table[triple & 0x3F] : '=';
+	}
+	out[out_len] = '\0';
+	return true;
+}
+
+/**
+ * JSON payloads start with an object or an array, base64 never does
+ */
+bool REPORTCODEC_is_binary(const char * payload){
+	return payload[0] != '{' && payload[0] != '[';
+}
+
+static void REPORTCODEC_put(REPORTCODEC_t * codec, uint8_t data){
+	if(codec->len >= REPORTCODEC_FRAME_MAX_LEN){
+		codec->overflow = true;
+		return;
+	}
+	codec->buf[codec->len++] = data;
+}
+
+static void REPORTCODEC_varint(REPORTCODEC_t * codec, uint32_t value){
+	while(value >= 0x80){
+		REPORTCODEC_put(codec, (value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+	REPORTCODEC_put(codec, value);
+}
@@ -6,10 +6,93 @@
  */
 
 
+#include "main.h"
 #include "App/schedulerport.h"
+#include "App/eventbus.h"
 #include "Lib/scheduler/scheduler.h"
 #include "Hal/timer.h"
+#include "Hal/uart.h"
+
+// UARTs enabled in UART_init
+static const UART_id_t rx_uart_table[] = {UART_1, UART_2, UART_4};
+
+static uint32_t last_run_count = 0;
+static uint32_t start_ticks = 0;
+// Sleep accounting
+static uint32_t sleep_count = 0;
+static uint32_t sleep_ms = 0;
+static uint32_t sleep_counts = 0;
+
+static bool SCHEDULERPORT_have_pending_rx();
 
 void SCHEDULERPORT_init(){
+	SCH_Init();
 	TIMER_attach_intr_1ms(SCH_Update);
+	start_ticks = SCH_Get_Ticks();
+}
+
+void SCHEDULERPORT_sleep(){
+#if SCHEDULERPORT_TICKLESS
+	uint32_t deadline;
+	uint32_t start_counts;
+	uint32_t counts;
+	uint32_t ticks;
+	// A task ran in this pass -> its flags are handled in the next pass
+	if(SCH_Get_Run_Count() != last_run_count){
+		last_run_count = SCH_Get_Run_Count();
+		return;
+	}
+	if(SCHEDULERPORT_have_pending_rx()){
+		return;
+	}
+	__disable_irq();
+	deadline = SCH_Get_Next_Deadline();
+	// An event posted by an interrupt after the last pass must be handled first
+	if(deadline <= 1 || EVENTBUS_is_pending()){
+		__enable_irq();
+		return;
+	}
+	if(deadline > SCHEDULERPORT_MAX_SLEEP){
+		deadline = SCHEDULERPORT_MAX_SLEEP;
+	}
+	start_counts = TIMER_get_counts();
+	if(TIMER_suppress_intr_1ms(deadline) == 0){
+		// The 1ms tick is pending, let its interrupt count it
+		__enable_irq();
+		return;
+	}
+	HAL_SuspendTick();
+	// Wake on the TIM3 deadline or any peripheral interrupt (UART RX, EXTI)
+	__DSB();
+	__WFI();
+	counts = TIMER_resume_intr_1ms();
+	ticks = counts / TIMER_COUNTS_PER_TICK;
+	SCH_Update_Ticks(ticks);
+	// Keep HAL_GetTick() in step with the suppressed SysTick interrupts
+	for(uint32_t tick = 0; tick < ticks; tick ++){
+		HAL_IncTick();
+	}
+	HAL_ResumeTick();
+	sleep_count ++;
+	sleep_counts += counts - start_counts;
+	sleep_ms += sleep_counts / TIMER_COUNTS_PER_TICK;
+	sleep_counts %= TIMER_COUNTS_PER_TICK;
+	__enable_irq();
+#endif
+}
+
+void SCHEDULERPORT_get_stats(SCHEDULERPORT_stats_t * stats){
+	uint32_t total_ms = SCH_Get_Ticks() - start_ticks;
+	stats->sleep_count = sleep_count;
+	stats->sleep_ms = sleep_ms;
+	stats->busy_ms = total_ms > sleep_ms ? total_ms - sleep_ms : 0;
+}
+
+static bool SCHEDULERPORT_have_pending_rx(){
+	for (int var = 0; var < sizeof(rx_uart_table)/sizeof(rx_uart_table[0]); ++var) {
+		if(UART_receive_available(rx_uart_table[var]) || UART_receive_frame_available(rx_uart_table[var])){
+			return true;
+		}
+	}
+	return false;
 }
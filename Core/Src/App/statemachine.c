@@ -10,14 +10,29 @@
 #include "App/mqtt.h"
 #include "App/statemachine.h"
 #include "App/statusreporter.h"
+#include "App/profiler.h"
 #include "App/commandhandler.h"
 #include "DeviceManager/billacceptormanager.h"
 #include "DeviceManager/keypadmanager.h"
 #include "DeviceManager/tcdmanager.h"
 #include "DeviceManager/lcdmanager.h"
+#include "App/eventbus.h"
+#include "Hal/uart.h"
 #include "Lib/scheduler/scheduler.h"
 #include "Lib/utils/utils_logger.h"
 
+// Events each module waits for, a module is skipped on the passes none of them is pending
+#define SM_WAKE_MQTT				(EVENT_MQTT | EVENT_NETIF_RX)
+#define SM_WAKE_STATUSREPORTER		(EVENT_STATUSREPORTER | EVENT_STATUS_CHANGED)
+#define SM_WAKE_COMMANDHANDLER		EVENT_COMMAND
+#define SM_WAKE_BILLACCEPTORMNG		EVENT_BILLACCEPTOR
+#define SM_WAKE_LCDMNG				EVENT_LCD
+#define SM_WAKE_KEYPADMNG			EVENT_KEYPAD
+#define SM_WAKE_KEYPADHANDLER		EVENT_KEYPADHANDLER
+#define SM_WAKE_TCDMNG				EVENT_TCD
+// The states react to bills, cards, keys, commands and their own timeouts
+#define SM_WAKE_STATE				(EVENT_STATE | EVENT_BILLACCEPTOR | EVENT_TCD | EVENT_KEYPADHANDLER | EVENT_COMMAND)
+
 enum {
 	SM_INIT,
 	SM_WAITING_FOR_INIT,
@@ -42,8 +57,11 @@ static void SM_maintenance();
 // Utils
 static void SM_update_total_card_by_time(RTC_t *rtc , CONFIG_t *config);
 static void SM_timeout();
+static void SM_start_timeout(uint32_t duration);
 static void SM_timeout_for_update();
 static void SM_printf();
+static void SM_run_critical(EVENTBUS_mask_t * events);
+static void SM_netif_rx_cb();
 // Callback
 static void SM_take_card_cb(TCD_id_t id);
 static void SM_callback_card_cb(TCD_id_t id);
@@ -51,7 +69,7 @@ static void SM_callback_card_cb(TCD_id_t id);
 
 static uint8_t prev_state = SM_INIT;
 static uint8_t state = SM_INIT;
-static uint8_t timeout_task_id;
+static uint32_t timeout_task_id = NO_TASK_ID;
 static const char * state_name[] = {
 		[SM_INIT] = "SM_INIT\r\n",
 		[SM_WAITING_FOR_INIT] = "SM_WAITING_FOR_INIT\r\n",
@@ -71,18 +89,56 @@ bool STATEMACHINE_init(){
 	// Set TCDMNG callback
 	TCDMNG_set_take_card_cb(SM_take_card_cb);
 	TCDMNG_set_callback_card_cb(SM_callback_card_cb);
+	// Working screen update timer
+	SCH_Add_Task_Priority(SM_timeout_for_update, SM_UPDATE_DURATION, SM_UPDATE_DURATION, SCH_PRIORITY_UI);
+	// Wake MQTT as soon as the WIFI/4G module sends something
+	UART_set_rx_callback(UART_1, SM_netif_rx_cb);
+	UART_set_rx_callback(UART_4, SM_netif_rx_cb);
+	// First pass runs every module
+	EVENTBUS_post(EVENT_ALL);
 }
 
 bool STATEMACHINE_run(){
-	MQTT_run();
-	STATUSREPORTER_run();
-	COMMANDHANDLER_run();
-	BILLACCEPTORMNG_run();
-	LCDMNG_run();
-	KEYPADMNG_run();
-	KEYPADHANDLER_run();
-	TCDMNG_run();
-	SCH_Dispatch_Tasks();
+	uint32_t profiler_start;
+	EVENTBUS_mask_t events;
+	PROFILER_loop();
+	// Expired timeouts post their events, dispatch them before taking the mask
+	PROFILER_RUN(PROFILER_SCHEDULER, SCH_Dispatch_Tasks());
+	events = EVENTBUS_take();
+	if(events & EVENT_INPUT){
+		// Someone is at the machine, a bill may follow
+		BILLACCEPTORMNG_notify_activity();
+	}
+	if(events & SM_WAKE_MQTT){
+		PROFILER_RUN(PROFILER_MQTT, MQTT_run());
+		SM_run_critical(&events);
+	}
+	if(events & SM_WAKE_STATUSREPORTER){
+		PROFILER_RUN(PROFILER_STATUSREPORTER, STATUSREPORTER_run());
+	}
+	if(events & SM_WAKE_COMMANDHANDLER){
+		PROFILER_RUN(PROFILER_COMMANDHANDLER, COMMANDHANDLER_run());
+	}
+	if(events & SM_WAKE_BILLACCEPTORMNG){
+		PROFILER_RUN(PROFILER_BILLACCEPTORMNG, BILLACCEPTORMNG_run());
+		SM_run_critical(&events);
+	}
+	if(events & SM_WAKE_LCDMNG){
+		PROFILER_RUN(PROFILER_LCDMNG, LCDMNG_run());
+	}
+	if(events & SM_WAKE_KEYPADMNG){
+		PROFILER_RUN(PROFILER_KEYPADMNG, KEYPADMNG_run());
+	}
+	if(events & SM_WAKE_KEYPADHANDLER){
+		PROFILER_RUN(PROFILER_KEYPADHANDLER, KEYPADHANDLER_run());
+	}
+	if(events & SM_WAKE_TCDMNG){
+		PROFILER_RUN(PROFILER_TCDMNG, TCDMNG_run());
+	}
+	if(!(events & SM_WAKE_STATE)){
+		return true;
+	}
+	profiler_start = PROFILER_start();
 	switch (state) {
 		case SM_INIT:
 			SM_init();
@@ -114,14 +170,16 @@ bool STATEMACHINE_run(){
 		default:
 			break;
 	}
+	PROFILER_stop(PROFILER_STATE, profiler_start);
 	SM_printf();
 	prev_state = state;
+	return true;
 }
 
 
 static void SM_init(){
 	state = SM_WAITING_FOR_INIT;
-	timeout_task_id = SCH_Add_Task(SM_timeout, SM_INIT_DURATION, 0);
+	SM_start_timeout(SM_INIT_DURATION);
 
 }
 static void SM_wait_for_init(){
@@ -142,7 +200,6 @@ static void SM_idle(){
 		config = CONFIG_get();
 		LCDMNG_set_working_screen_without_draw(&rtc, config->amount);
 		SM_update_total_card_by_time(&rtc, config);
-		SCH_Add_Task(SM_timeout_for_update, SM_UPDATE_DURATION, 0);
 	}
 	// Check if Card is error
 	if(TCDMNG_is_error()){
@@ -199,8 +256,7 @@ static void SM_idle(){
 		bill_value = BILLACCEPTOR_get_last_bill_accepted();
 		STATUSREPORTER_report_billaccepted(bill_value);
 		// Timeout to wait user can view money change
-		timeout = false;
-		timeout_task_id = SCH_Add_Task(SM_timeout, SM_BILLACCEPTOR_DURATION, 0);
+		SM_start_timeout(SM_BILLACCEPTOR_DURATION);
 		state = SM_BILL_ACCEPTED;
 		return;
 	}
@@ -240,9 +296,7 @@ static void SM_payouting_card(){
 		BILLACCEPTORMNG_set_amount(amount);
 		LCDMNG_set_working_screen(&rtc, config->amount);
 		// Timeout to check card is taken
-		timeout = false;
-		SCH_Delete_Task(timeout_task_id);
-		timeout_task_id = SCH_Add_Task(SM_timeout, SM_TAKING_CARD_TIMEOUT, 0);
+		SM_start_timeout(SM_TAKING_CARD_TIMEOUT);
 		// Report card dispense
 		STATUSREPORTER_report_dispense(DISPENSE_DIR_OUT);
 		state = SM_WAIT_FOR_PAYOUTING_CARD;
@@ -320,14 +374,42 @@ static void SM_update_total_card_by_time(RTC_t *rtc , CONFIG_t *config){
 
 static void SM_timeout(){
 	timeout = true;
+	EVENTBUS_post(EVENT_STATE);
+}
+
+static void SM_start_timeout(uint32_t duration){
+	timeout = false;
+	// Move the pending timeout, add a new one if it already fired
+	if(!SCH_Reschedule(timeout_task_id, duration)){
+		timeout_task_id = SCH_Add_Task_Priority(SM_timeout, duration, 0, SCH_PRIORITY_CRITICAL);
+	}
 }
 
 static void SM_timeout_for_update(){
 	timeout_for_update = true;
+	EVENTBUS_post(EVENT_STATE);
+}
+
+/**
+ * MQTT and the bill acceptor may block for hundreds of ms, service the
+ * critical timeouts (payout pulse, card taking) right after them.
+ */
+static void SM_run_critical(EVENTBUS_mask_t * events){
+	SCH_Dispatch_Tasks_Priority(SCH_PRIORITY_CRITICAL);
+	*events |= EVENTBUS_take();
+	if(*events & SM_WAKE_TCDMNG){
+		PROFILER_RUN(PROFILER_TCDMNG, TCDMNG_run());
+	}
+}
+
+static void SM_netif_rx_cb(){
+	EVENTBUS_post(EVENT_NETIF_RX);
 }
 
 static void SM_printf(){
 	if(prev_state != state){
+		// Run the new state right away instead of after the next sleep
+		EVENTBUS_post(EVENT_STATE);
 		utils_log_info(state_name[state]);
 	}
 }
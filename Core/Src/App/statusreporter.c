@@ -5,26 +5,63 @@
  *      Author: xuanthodo
  */
 
+#include "main.h"
+#include "string.h"
 #include "config.h"
 #include <App/mqtt.h>
 #include "App/statusreporter.h"
+#include "App/profiler.h"
+#include "App/eventbus.h"
+#include "App/outbox.h"
+#include "App/reportcodec.h"
+#include "App/msgpool.h"
 #include "DeviceManager/billacceptormanager.h"
 #include "DeviceManager/tcdmanager.h"
+#include "Hal/uart.h"
 #include "Lib/scheduler/scheduler.h"
 #include "Lib/netif/inc/manager/netif_manager.h"
 
-#define STATUSREPORT_INTERVAL		60 * 1000 	// 60s
+#define STATUSREPORT_INTERVAL		15 * 60 * 1000 	// 15min, full status
+#define STATUSREPORT_DELTA_INTERVAL	1000			// 1s at least between two deltas
+#define METRICS_INTERVAL			10 * 60 * 1000 	// 10min
+
+// Alert fields as last published
+typedef struct {
+	uint8_t connection_type;
+	TCDMNG_Status_t tcd_status;
+	uint8_t billacceptor_status;
+}STATUSREPORTER_snapshot_t;
+
+// Fields of a delta
+#define STATUSREPORTER_CON_TYPE		(1 << 0)
+#define STATUSREPORTER_TCD_1		(1 << 1)
+#define STATUSREPORTER_TCD_2		(1 << 2)
+#define STATUSREPORTER_BILL			(1 << 3)
 
 static bool timeout_flag = true;
+static bool metrics_flag = false;
+static STATUSREPORTER_snapshot_t last_snapshot;
+static uint32_t last_delta = 0;
+static uint32_t delta_task_id = NO_TASK_ID;		// Delta held back by STATUSREPORT_DELTA_INTERVAL
 
 // Private function
+static MQTT_message_t * STATUSREPORTER_alloc_message(MSGPOOL_handle_t * handle, uint8_t qos, uint8_t retain, uint8_t persistent);
 static void STATUSREPORTER_report_status();
+static void STATUSREPORTER_report_delta();
+static void STATUSREPORTER_take_snapshot(STATUSREPORTER_snapshot_t * snapshot);
+static uint8_t STATUSREPORTER_compare_snapshot(STATUSREPORTER_snapshot_t * snapshot);
+static bool STATUSREPORTER_tcd_is_equal(TCD_status_t * a, TCD_status_t * b);
+static void STATUSREPORTER_build_delta_payload(char * buf, STATUSREPORTER_snapshot_t * snapshot, uint8_t changed);
+static void STATUSREPORTER_build_tcd(char * buf, size_t size, TCD_status_t * tcd);
 static void STATUSREPORTER_build_status_topic(char * buf, char * device_id);
+static void STATUSREPORTER_build_status_delta_topic(char * buf, char * device_id);
 static void STATUSREPORTER_build_status_payload(char * buf,
 													CONFIG_t* config,
 													uint8_t connection_type,
 													TCDMNG_Status_t tcd_status,
-													uint8_t billacepptor_status);
+													uint8_t billacepptor_status,
+													OUTBOX_stats_t * outbox_stats,
+													MSGPOOL_stats_t * pool_stats);
 static void STATUSREPORTER_build_bill_accepted_topic(char * buf, char * device_id);
 static void STATUSREPORTER_build_bill_accepted_payload(char * buf, uint32_t bill_value);
 static void STATUSREPORTER_build_dispense_topic(char * buf, char * device_id);
@@ -32,10 +69,14 @@ static void STATUSREPORTER_build_dispense_payload(char * buf, uint32_t direction
 static void STATUSREPORTER_build_transaction_topic(char * buf, char * device_id);
 static void STATUSREPORTER_build_transaction_payload(char * buf, uint32_t transaction_bill,
 																uint32_t transaction_quantity);
+static void STATUSREPORTER_build_metrics_topic(char * buf, char * device_id);
 static void STATUSREPORTER_timeout();
+static void STATUSREPORTER_timeout_for_metrics();
+static void STATUSREPORTER_timeout_for_delta();
 
 bool STATUSREPORTER_init(){
-
+	SCH_Add_Task_Priority(STATUSREPORTER_timeout, STATUSREPORT_INTERVAL, STATUSREPORT_INTERVAL, SCH_PRIORITY_UI);
+	SCH_Add_Task_Priority(STATUSREPORTER_timeout_for_metrics, METRICS_INTERVAL, METRICS_INTERVAL, SCH_PRIORITY_UI);
 }
 
 bool STATUSREPORTER_run(){
@@ -43,67 +84,226 @@ bool STATUSREPORTER_run(){
 		timeout_flag = false;
 		// Publish status
 		STATUSREPORTER_report_status();
-		SCH_Add_Task(STATUSREPORTER_timeout, STATUSREPORT_INTERVAL, 0);
+	}
+	// Woken by EVENT_STATUS_CHANGED or the held back delta: publish the alert fields
+	// changed since the last report
+	STATUSREPORTER_report_delta();
+	if(metrics_flag){
+		metrics_flag = false;
+		// Dump profiling on debug UART then publish the summary
+		PROFILER_dump();
+		STATUSREPORTER_report_metrics();
 	}
 }
 
 void STATUSREPORTER_report_billaccepted(uint32_t bill_value){
 	CONFIG_t *config = CONFIG_get();
-	MQTT_message_t message = {
-		.qos = 1,
-		.retain = 0
-	};
+	MSGPOOL_handle_t handle;
+	MQTT_message_t * message = STATUSREPORTER_alloc_message(&handle, 1, 0, 1);
+	if(message == NULL){
+		return;
+	}
 	// Build Topic
-	STATUSREPORTER_build_bill_accepted_topic(message.topic, config->device_id);
-	STATUSREPORTER_build_bill_accepted_payload(message.payload, bill_value);
+	STATUSREPORTER_build_bill_accepted_topic(message->topic, config->device_id);
+	STATUSREPORTER_build_bill_accepted_payload(message->payload, bill_value);
 	// Send message
-	MQTT_sent_message(&message);
+	MQTT_sent_message(handle);
 }
 
 void STATUSREPORTER_report_dispense(uint32_t direction){
 	CONFIG_t *config = CONFIG_get();
-	MQTT_message_t message = {
-		.qos = 1,
-		.retain = 0
-	};
+	MSGPOOL_handle_t handle;
+	MQTT_message_t * message = STATUSREPORTER_alloc_message(&handle, 1, 0, 1);
+	if(message == NULL){
+		return;
+	}
 	// Build Topic
-	STATUSREPORTER_build_dispense_topic(message.topic, config->device_id);
-	STATUSREPORTER_build_dispense_payload(message.payload, direction);
+	STATUSREPORTER_build_dispense_topic(message->topic, config->device_id);
+	STATUSREPORTER_build_dispense_payload(message->payload, direction);
 	// Send message
-	MQTT_sent_message(&message);
+	MQTT_sent_message(handle);
 }
 
 
 void STATUSREPORTER_report_transaction(uint32_t card_price, uint32_t transaction_quantity){
 	CONFIG_t *config = CONFIG_get();
-	MQTT_message_t message = {
-		.qos = 1,
-		.retain = 0
-	};
+	MSGPOOL_handle_t handle;
+	MQTT_message_t * message = STATUSREPORTER_alloc_message(&handle, 1, 0, 1);
+	if(message == NULL){
+		return;
+	}
+	// Build Topic
+	STATUSREPORTER_build_transaction_topic(message->topic, config->device_id);
+	STATUSREPORTER_build_transaction_payload(message->payload, card_price, transaction_quantity);
+	// Send message
+	MQTT_sent_message(handle);
+}
+
+void STATUSREPORTER_report_metrics(){
+	CONFIG_t *config = CONFIG_get();
+	BILLACCEPTORMNG_stats_t bill_stats;
+	CONFIG_stats_t config_stats;
+	char persist[64];
+	size_t len;
+	MSGPOOL_handle_t handle;
+	MQTT_message_t * message = STATUSREPORTER_alloc_message(&handle, 0, 0, 0);
+	if(message == NULL){
+		return;
+	}
 	// Build Topic
-	STATUSREPORTER_build_transaction_topic(message.topic, config->device_id);
-	STATUSREPORTER_build_transaction_payload(message.payload, card_price, transaction_quantity);
+	STATUSREPORTER_build_metrics_topic(message->topic, config->device_id);
+	len = PROFILER_build_metrics(message->payload, PAYLOAD_MAX_LEN);
+	// Append the bill acceptor polling and the UART losses to the profiler object
+	if(len > 0 && message->payload[len - 1] == '}'){
+		BILLACCEPTORMNG_get_stats(&bill_stats);
+		snprintf(message->payload + len - 1, PAYLOAD_MAX_LEN - len + 1, ",\"b\":[%d,%d,%d,%d,%d,%d,%d],\"u\":[%d,%d,%d],\"w\":[%d,%d,%d]}",
+				bill_stats.poll_count,
+				bill_stats.fast_poll_count,
+				bill_stats.no_response_count,
+				bill_stats.poll_interval,
+				bill_stats.poll_count ? bill_stats.response_time_total / bill_stats.poll_count : 0,
+				bill_stats.response_time_max,
+				bill_stats.event_count,
+				UART_get_overrun_count(UART_1),
+				UART_get_overrun_count(UART_4),
+				UART_get_frame_drop_count(UART_2),
+				UART_get_tx_drop_count(UART_1),
+				UART_get_tx_drop_count(UART_2),
+				UART_get_tx_drop_count(UART_4));
+		len = strlen(message->payload);
+	}
+	// EEPROM write-back, only when it fits so that the object stays whole
+	if(len > 0 && message->payload[len - 1] == '}'){
+		CONFIG_get_stats(&config_stats);
+		snprintf(persist, sizeof(persist), ",\"p\":[%d,%d,%d,%d,%d]}",
+				config_stats.flush_count,
+				config_stats.power_fail_count,
+				config_stats.write_error_count,
+				config_stats.flush_ms_max,
+				config_stats.dirty_ms_max);
+		if(len - 1 + strlen(persist) < PAYLOAD_MAX_LEN){
+			strcpy(message->payload + len - 1, persist);
+		}
+	}
 	// Send message
-	MQTT_sent_message(&message);
+	MQTT_sent_message(handle);
 }
 
 static void STATUSREPORTER_report_status(){
 	CONFIG_t *config = CONFIG_get();
-	MQTT_message_t message = {
-		.qos = 1,
-		.retain = 1
-	};
+	MSGPOOL_handle_t handle;
+	MQTT_message_t * message = STATUSREPORTER_alloc_message(&handle, 1, 1, 0);
+	if(message == NULL){
+		return;
+	}
 
 	// Build Topic
-	STATUSREPORTER_build_status_topic(message.topic, config->device_id);
+	STATUSREPORTER_build_status_topic(message->topic, config->device_id);
 	// Build Payload
 	TCDMNG_Status_t tcd_status = TCDMNG_get_status();
 	uint8_t billacceptor_status = BILLACCEPTORMNG_get_status();
 	uint8_t connection_type = netif_manager_get_mode();
 
-	STATUSREPORTER_build_status_payload(message.payload, config, connection_type, tcd_status, billacceptor_status);
+	OUTBOX_stats_t outbox_stats;
+	OUTBOX_get_stats(&outbox_stats);
+	MSGPOOL_stats_t pool_stats;
+	MSGPOOL_get_stats(&pool_stats);
+
+	STATUSREPORTER_build_status_payload(message->payload, config, connection_type, tcd_status, billacceptor_status, &outbox_stats, &pool_stats);
+	// Send message
+	if(MQTT_sent_message(handle)){
+		// The deltas start again from this one
+		last_snapshot.connection_type = connection_type;
+		last_snapshot.tcd_status = tcd_status;
+		last_snapshot.billacceptor_status = billacceptor_status;
+	}
+}
+
+/**
+ * Only the alert fields changed since the last status or delta, at most one every
+ * STATUSREPORT_DELTA_INTERVAL, a change within it is sent when it ends. The changes
+ * wait while MQTT is down, they go out together once it is back
+ */
+static void STATUSREPORTER_report_delta(){
+	CONFIG_t *config = CONFIG_get();
+	STATUSREPORTER_snapshot_t snapshot;
+	MSGPOOL_handle_t handle;
+	MQTT_message_t * message;
+	uint8_t changed;
+	STATUSREPORTER_take_snapshot(&snapshot);
+	changed = STATUSREPORTER_compare_snapshot(&snapshot);
+	if(changed == 0 || !MQTT_is_ready()){
+		return;
+	}
+	if(HAL_GetTick() - last_delta < STATUSREPORT_DELTA_INTERVAL){
+		if(!SCH_Is_Task_Alive(delta_task_id)){
+			delta_task_id = SCH_Add_Task_Priority(STATUSREPORTER_timeout_for_delta,
+					STATUSREPORT_DELTA_INTERVAL - (HAL_GetTick() - last_delta), 0, SCH_PRIORITY_UI);
+		}
+		return;
+	}
+	message = STATUSREPORTER_alloc_message(&handle, 1, 0, 0);
+	if(message == NULL){
+		// Pool empty, try again after the interval
+		if(!SCH_Is_Task_Alive(delta_task_id)){
+			delta_task_id = SCH_Add_Task_Priority(STATUSREPORTER_timeout_for_delta,
+					STATUSREPORT_DELTA_INTERVAL, 0, SCH_PRIORITY_UI);
+		}
+		return;
+	}
+	// Build Topic
+	STATUSREPORTER_build_status_delta_topic(message->topic, config->device_id);
+	STATUSREPORTER_build_delta_payload(message->payload, &snapshot, changed);
 	// Send message
-	MQTT_sent_message(&message);
+	if(MQTT_sent_message(handle)){
+		last_delta = HAL_GetTick();
+		memcpy(&last_snapshot, &snapshot, sizeof(STATUSREPORTER_snapshot_t));
+	}
+}
+
+static void STATUSREPORTER_take_snapshot(STATUSREPORTER_snapshot_t * snapshot){
+	snapshot->connection_type = netif_manager_get_mode();
+	snapshot->tcd_status = TCDMNG_get_status();
+	snapshot->billacceptor_status = BILLACCEPTORMNG_get_status();
+}
+
+static uint8_t STATUSREPORTER_compare_snapshot(STATUSREPORTER_snapshot_t * snapshot){
+	uint8_t changed = 0;
+	if(snapshot->connection_type != last_snapshot.connection_type){
+		changed |= STATUSREPORTER_CON_TYPE;
+	}
+	if(!STATUSREPORTER_tcd_is_equal(&snapshot->tcd_status.TCD_1, &last_snapshot.tcd_status.TCD_1)){
+		changed |= STATUSREPORTER_TCD_1;
+	}
+	if(!STATUSREPORTER_tcd_is_equal(&snapshot->tcd_status.TCD_2, &last_snapshot.tcd_status.TCD_2)){
+		changed |= STATUSREPORTER_TCD_2;
+	}
+	if(snapshot->billacceptor_status != last_snapshot.billacceptor_status){
+		changed |= STATUSREPORTER_BILL;
+	}
+	return changed;
+}
+
+static bool STATUSREPORTER_tcd_is_equal(TCD_status_t * a, TCD_status_t * b){
+	return a->is_empty == b->is_empty
+			&& a->is_error == b->is_error
+			&& a->is_lower == b->is_lower;
+}
+
+/**
+ * Slot of the message pool to build the report in. The billing reports go straight to
+ * the outbox, they take the reserved slot when the others are queued
+ */
+static MQTT_message_t * STATUSREPORTER_alloc_message(MSGPOOL_handle_t * handle, uint8_t qos, uint8_t retain, uint8_t persistent){
+	MQTT_message_t * message;
+	*handle = persistent ? MSGPOOL_alloc_reserved() : MSGPOOL_alloc();
+	message = MSGPOOL_get(*handle);
+	if(message != NULL){
+		message->qos = qos;
+		message->retain = retain;
+		message->persistent = persistent;
+	}
+	return message;
 }
 static void STATUSREPORTER_build_status_topic(char * buf, char * device_id){
 	snprintf(buf,
@@ -117,7 +317,33 @@ static void STATUSREPORTER_build_status_payload(char * buf,
 													CONFIG_t* config,
 													uint8_t connection_type,
 													TCDMNG_Status_t tcd_status,
-													uint8_t billacepptor_status){
+													uint8_t billacepptor_status,
+													OUTBOX_stats_t * outbox_stats,
+													MSGPOOL_stats_t * pool_stats){
+	REPORTCODEC_t codec;
+	if(config->report_format == CONFIG_REPORT_BINARY){
+		uint32_t tcd_1[] = {tcd_status.TCD_1.is_empty, tcd_status.TCD_1.is_error, tcd_status.TCD_1.is_lower};
+		uint32_t tcd_2[] = {tcd_status.TCD_2.is_empty, tcd_status.TCD_2.is_error, tcd_status.TCD_2.is_lower};
+		uint32_t ob[] = {outbox_stats->depth, outbox_stats->oldest_age, outbox_stats->drop_count, MQTT_get_retransmit_count()};
+		uint32_t mp[] = {pool_stats->used, pool_stats->peak, pool_stats->fail_count};
+		REPORTCODEC_begin(&codec, REPORTCODEC_STATUS);
+		REPORTCODEC_string(&codec, REPORTCODEC_STATUS_V, config->version, sizeof(config->version));
+		REPORTCODEC_uint(&codec, REPORTCODEC_STATUS_CON_TYPE, connection_type);
+		REPORTCODEC_string(&codec, REPORTCODEC_STATUS_PWD, config->password, sizeof(config->password));
+		REPORTCODEC_uint(&codec, REPORTCODEC_STATUS_CP, config->card_price);
+		REPORTCODEC_uint(&codec, REPORTCODEC_STATUS_AMT, config->amount);
+		REPORTCODEC_uint(&codec, REPORTCODEC_STATUS_TO_AMT, config->total_amount);
+		REPORTCODEC_uint(&codec, REPORTCODEC_STATUS_TO_CA, config->total_card);
+		REPORTCODEC_uint(&codec, REPORTCODEC_STATUS_TO_CA_D, config->total_card_by_day);
+		REPORTCODEC_uint(&codec, REPORTCODEC_STATUS_TO_CA_M, config->total_card_by_month);
+		REPORTCODEC_array(&codec, REPORTCODEC_STATUS_TCD_1, tcd_1, 3);
+		REPORTCODEC_array(&codec, REPORTCODEC_STATUS_TCD_2, tcd_2, 3);
+		REPORTCODEC_uint(&codec, REPORTCODEC_STATUS_BILL, billacepptor_status);
+		REPORTCODEC_array(&codec, REPORTCODEC_STATUS_OB, ob, 4);
+		REPORTCODEC_array(&codec, REPORTCODEC_STATUS_MP, mp, 3);
+		REPORTCODEC_end(&codec, buf, PAYLOAD_MAX_LEN);
+		return;
+	}
 	snprintf(buf,
 				PAYLOAD_MAX_LEN,
 				"{"
@@ -132,7 +358,9 @@ static void STATUSREPORTER_build_status_payload(char * buf,
 					"\"to_ca_m\":%d,"
 					"\"tcd_1\":[%d,%d,%d],"
 					"\"tcd_2\":[%d,%d,%d],"
-					"\"bill\": %d"
+					"\"bill\": %d,"
+					"\"ob\":[%d,%d,%d,%d],"
+					"\"mp\":[%d,%d,%d]"
 				"}",
 					config->version,
 					connection_type,
@@ -149,7 +377,70 @@ static void STATUSREPORTER_build_status_payload(char * buf,
 					tcd_status.TCD_2.is_empty,
 					tcd_status.TCD_2.is_error,
 					tcd_status.TCD_2.is_lower,
-					billacepptor_status);
+					billacepptor_status,
+					outbox_stats->depth,
+					outbox_stats->oldest_age,
+					outbox_stats->drop_count,
+					MQTT_get_retransmit_count(),
+					pool_stats->used,
+					pool_stats->peak,
+					pool_stats->fail_count);
+}
+
+static void STATUSREPORTER_build_status_delta_topic(char * buf, char * device_id){
+	snprintf(buf,
+			TOPIC_MAX_LEN,
+			"%s/%s/rp/status_delta",
+			MODEL,
+			device_id);
+}
+
+static void STATUSREPORTER_build_delta_payload(char * buf, STATUSREPORTER_snapshot_t * snapshot, uint8_t changed){
+	REPORTCODEC_t codec;
+	char tcd[16];
+	size_t len = 0;
+	if(CONFIG_get()->report_format == CONFIG_REPORT_BINARY){
+		uint32_t tcd_1[] = {snapshot->tcd_status.TCD_1.is_empty, snapshot->tcd_status.TCD_1.is_error, snapshot->tcd_status.TCD_1.is_lower};
+		uint32_t tcd_2[] = {snapshot->tcd_status.TCD_2.is_empty, snapshot->tcd_status.TCD_2.is_error, snapshot->tcd_status.TCD_2.is_lower};
+		REPORTCODEC_begin(&codec, REPORTCODEC_STATUS_DELTA);
+		if(changed & STATUSREPORTER_CON_TYPE){
+			REPORTCODEC_uint(&codec, REPORTCODEC_STATUS_CON_TYPE, snapshot->connection_type);
+		}
+		if(changed & STATUSREPORTER_TCD_1){
+			REPORTCODEC_array(&codec, REPORTCODEC_STATUS_TCD_1, tcd_1, 3);
+		}
+		if(changed & STATUSREPORTER_TCD_2){
+			REPORTCODEC_array(&codec, REPORTCODEC_STATUS_TCD_2, tcd_2, 3);
+		}
+		if(changed & STATUSREPORTER_BILL){
+			REPORTCODEC_uint(&codec, REPORTCODEC_STATUS_BILL, snapshot->billacceptor_status);
+		}
+		REPORTCODEC_end(&codec, buf, PAYLOAD_MAX_LEN);
+		return;
+	}
+	// Same keys and values as the status
+	buf[len++] = '{';
+	if(changed & STATUSREPORTER_CON_TYPE){
+		len += snprintf(buf + len, PAYLOAD_MAX_LEN - len, "\"con_type\":\"%d\",", snapshot->connection_type);
+	}
+	if(changed & STATUSREPORTER_TCD_1){
+		STATUSREPORTER_build_tcd(tcd, sizeof(tcd), &snapshot->tcd_status.TCD_1);
+		len += snprintf(buf + len, PAYLOAD_MAX_LEN - len, "\"tcd_1\":%s,", tcd);
+	}
+	if(changed & STATUSREPORTER_TCD_2){
+		STATUSREPORTER_build_tcd(tcd, sizeof(tcd), &snapshot->tcd_status.TCD_2);
+		len += snprintf(buf + len, PAYLOAD_MAX_LEN - len, "\"tcd_2\":%s,", tcd);
+	}
+	if(changed & STATUSREPORTER_BILL){
+		len += snprintf(buf + len, PAYLOAD_MAX_LEN - len, "\"bill\":%d,", snapshot->billacceptor_status);
+	}
+	// The last comma closes the object
+	buf[len - 1] = '}';
+	buf[len] = '\0';
+}
+
+static void STATUSREPORTER_build_tcd(char * buf, size_t size, TCD_status_t * tcd){
+	snprintf(buf, size, "[%d,%d,%d]", tcd->is_empty, tcd->is_error, tcd->is_lower);
 }
 
 static void STATUSREPORTER_build_bill_accepted_topic(char * buf, char * device_id){
@@ -161,6 +452,13 @@ static void STATUSREPORTER_build_bill_accepted_topic(char * buf, char * device_i
 }
 
 static void STATUSREPORTER_build_bill_accepted_payload(char * buf, uint32_t bill_value){
+	REPORTCODEC_t codec;
+	if(CONFIG_get()->report_format == CONFIG_REPORT_BINARY){
+		REPORTCODEC_begin(&codec, REPORTCODEC_BILL_ACCEPTED);
+		REPORTCODEC_uint(&codec, REPORTCODEC_BILL_ACCEPTED_VALUE, bill_value);
+		REPORTCODEC_end(&codec, buf, PAYLOAD_MAX_LEN);
+		return;
+	}
 	snprintf(buf,
 				PAYLOAD_MAX_LEN,
 				"{"
@@ -178,6 +476,13 @@ static void STATUSREPORTER_build_dispense_topic(char * buf, char * device_id){
 }
 
 static void STATUSREPORTER_build_dispense_payload(char * buf, uint32_t direction){
+	REPORTCODEC_t codec;
+	if(CONFIG_get()->report_format == CONFIG_REPORT_BINARY){
+		REPORTCODEC_begin(&codec, REPORTCODEC_DISPENSE);
+		REPORTCODEC_uint(&codec, REPORTCODEC_DISPENSE_DIR, direction);
+		REPORTCODEC_end(&codec, buf, PAYLOAD_MAX_LEN);
+		return;
+	}
 	snprintf(buf,
 				PAYLOAD_MAX_LEN,
 				"{"
@@ -196,6 +501,14 @@ static void STATUSREPORTER_build_transaction_topic(char * buf, char * device_id)
 
 static void STATUSREPORTER_build_transaction_payload(char * buf, uint32_t card_price,
 																uint32_t transaction_quantity){
+	REPORTCODEC_t codec;
+	if(CONFIG_get()->report_format == CONFIG_REPORT_BINARY){
+		REPORTCODEC_begin(&codec, REPORTCODEC_TRANSACTION);
+		REPORTCODEC_uint(&codec, REPORTCODEC_TRANSACTION_PRICE, card_price);
+		REPORTCODEC_uint(&codec, REPORTCODEC_TRANSACTION_QUANTITY, transaction_quantity);
+		REPORTCODEC_end(&codec, buf, PAYLOAD_MAX_LEN);
+		return;
+	}
 	snprintf(buf,
 				PAYLOAD_MAX_LEN,
 				"{"
@@ -206,6 +519,25 @@ static void STATUSREPORTER_build_transaction_payload(char * buf, uint32_t card_p
 				transaction_quantity);
 }
 
+static void STATUSREPORTER_build_metrics_topic(char * buf, char * device_id){
+	snprintf(buf,
+			TOPIC_MAX_LEN,
+			"%s/%s/rp/metrics",
+			MODEL,
+			device_id);
+}
+
 static void STATUSREPORTER_timeout(){
 	timeout_flag = true;
+	EVENTBUS_post(EVENT_STATUSREPORTER);
+}
+
+static void STATUSREPORTER_timeout_for_metrics(){
+	metrics_flag = true;
+	EVENTBUS_post(EVENT_STATUSREPORTER);
+}
+
+static void STATUSREPORTER_timeout_for_delta(){
+	delta_task_id = NO_TASK_ID;
+	EVENTBUS_post(EVENT_STATUSREPORTER);
 }
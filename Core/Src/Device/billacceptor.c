@@ -7,210 +7,148 @@
 
 #include <Device/billacceptor.h>
 #include "main.h"
-#include "Hal/timer.h"
+#include "string.h"
 #include "Hal/uart.h"
+#include "Lib/scheduler/scheduler.h"
 
 #define BILLACCEPTOR_UART	UART_2
-#define BILLACCEPTOR_RES_TIMEOUT		300  	// 200ms
+#define BILLACCEPTOR_RES_TIMEOUT		300  	// 300ms
+#define BILLACCEPTOR_POLL_TIMEOUT		50		// 50ms
 #define BILLACCEPTOR_VALIDATOR_MODE		0x30
 #define BILLACCEPTOR_ADDRESS_BIT	0x100
 #define BILLACCEPTOR_DATA_BIT		0x000
 #define BILLACCEPTOR_ACK_BYTE		0x00
 #define BILLACCEPTOR_RET_BYTE		0xAA
 #define BILLACCEPTOR_NACK_BYTE 		0xFF
+#define BILLACCEPTOR_RES_MAX		UART_FRAME_MAX_LEN
 
-typedef enum {
-	BILLACCEPTOR_RESET = 0x30,
-	BILLACCEPTOR_SETUP = 0x31,
-	BILLACCEPTOR_SECURITY = 0x32,
-	BILLACCEPTOR_POLL = 0x33,
-	BILLACCEPTOR_BILLTYPE = 0x34,
-	BILLACCEPTOR_ESCROW = 0x35,
-	BILLACCEPTOR_STACKER = 0x36,
-	BILLACCEPTOR_EXPANSION_CMD = 0x37
-}BILLACCEPTOR_Cmd_Code_t;
-
-static uint32_t billacceptor_timecnt = 0;
-static bool billacceptor_timeout_occur = false;
-static uint16_t tx_buf[64];
+enum {
+	BILLACCEPTOR_ENGINE_IDLE,
+	BILLACCEPTOR_ENGINE_WAIT_RESPONSE
+};
+
+typedef struct {
+	uint16_t cmd[BILLACCEPTOR_CMD_MAX];
+	size_t cmd_len;
+	void * out;
+}BILLACCEPTOR_Request_t;
 
+// Longest response by command, POLL is variable up to this length
+static const uint8_t res_len_table[] = {
+	[BILLACCEPTOR_RESET - BILLACCEPTOR_RESET] = 1,
+	[BILLACCEPTOR_SETUP - BILLACCEPTOR_RESET] = 28,
+	[BILLACCEPTOR_SECURITY - BILLACCEPTOR_RESET] = 1,
+	[BILLACCEPTOR_POLL - BILLACCEPTOR_RESET] = 17,
+	[BILLACCEPTOR_BILLTYPE - BILLACCEPTOR_RESET] = 1,
+	[BILLACCEPTOR_ESCROW - BILLACCEPTOR_RESET] = 1,
+	[BILLACCEPTOR_STACKER - BILLACCEPTOR_RESET] = 3,
+	[BILLACCEPTOR_EXPANSION_CMD - BILLACCEPTOR_RESET] = 1,
+};
+
+static uint16_t tx_buf[64];
+// Request queue, the head is the request on the link
+static BILLACCEPTOR_Request_t queue[BILLACCEPTOR_QUEUE_SIZE];
+static size_t queue_head = 0;
+static size_t queue_len = 0;
+// Response of the request on the link
+static uint8_t engine_state = BILLACCEPTOR_ENGINE_IDLE;
+static uint16_t res_buf[BILLACCEPTOR_RES_MAX];
+static size_t res_len = 0;
+static bool timeout = false;
+static uint32_t timeout_task_id = NO_TASK_ID;
+static BILLACCEPTOR_Done_cb done_cb = NULL;
+static BILLACCEPTOR_Wake_cb wake_cb = NULL;
 
-static void BILLACCEPTOR_on_1ms_interrupt();
+static bool BILLACCEPTOR_queue(uint16_t *cmd, size_t cmd_len, void * out);
+static void BILLACCEPTOR_start_request();
+static void BILLACCEPTOR_wait_response();
+static void BILLACCEPTOR_complete(BILLACCEPTOR_Result_t result);
+static BILLACCEPTOR_Result_t BILLACCEPTOR_parse_response(BILLACCEPTOR_Request_t * request);
+static void BILLACCEPTOR_parse_setup(BILLACCEPTOR_Setup_t *setup);
+static void BILLACCEPTOR_parse_poll(BILLACCEPTOR_PollEvents_t * poll, size_t event_count);
+static void BILLACCEPTOR_parse_stacker(BILLACCEPTOR_Stacker_t * stacker);
+static void BILLACCEPTOR_timeout();
+static void BILLACCEPTOR_start_timeout(uint32_t duration);
+static void BILLACCEPTOR_on_rx();
 static bool BILLACCEPTOR_send_data(uint16_t *data , size_t data_len);
 static bool BILLACCEPTOR_clear_data();
 static uint8_t BILLACCEPTOR_calculate_chk(uint16_t * data, size_t data_len);
-static bool BILLACCEPTOR_receive_response(uint16_t *data, size_t data_len);
-static bool BILLACCEPTOR_receive_response_timeout(uint16_t *data, size_t expected_len, size_t * real_len, uint16_t timeout);
 static bool BILLACCEPTOR_is_res_ack(uint16_t code);
 static void BILLACCEPTOR_send_ack();
 
 bool BILLACCEPTOR_init(){
-	TIMER_attach_intr_1ms(BILLACCEPTOR_on_1ms_interrupt);
+	UART_set_rx_callback(BILLACCEPTOR_UART, BILLACCEPTOR_on_rx);
+	return true;
 }
 
-bool BILLACCEPTOR_reset(){
-	BILLACCEPTOR_clear_data();
-	uint8_t cmd[1] = {BILLACCEPTOR_RESET};
-	BILLACCEPTOR_send_data(cmd, 1);
-	uint16_t code;
-	if(!BILLACCEPTOR_receive_response(&code, 1)){
-		return false;
+/**
+ * Send the queued commands and consume their responses, never blocks.
+ * Call it whenever the wake callback fired.
+ */
+void BILLACCEPTOR_run(){
+	if(engine_state == BILLACCEPTOR_ENGINE_WAIT_RESPONSE){
+		BILLACCEPTOR_wait_response();
 	}
-	if(!BILLACCEPTOR_is_res_ack(code)){
-		return false;
+	if(engine_state == BILLACCEPTOR_ENGINE_IDLE && queue_len > 0){
+		BILLACCEPTOR_start_request();
 	}
-	return true;
+}
+
+bool BILLACCEPTOR_is_busy(){
+	return engine_state != BILLACCEPTOR_ENGINE_IDLE || queue_len > 0;
+}
+
+void BILLACCEPTOR_set_done_callback(BILLACCEPTOR_Done_cb callback){
+	done_cb = callback;
+}
+
+void BILLACCEPTOR_set_wake_callback(BILLACCEPTOR_Wake_cb callback){
+	wake_cb = callback;
+}
+
+bool BILLACCEPTOR_reset(){
+	uint16_t cmd[1] = {BILLACCEPTOR_RESET};
+	return BILLACCEPTOR_queue(cmd, 1, NULL);
 }
 
 bool BILLACCEPTOR_setup(BILLACCEPTOR_Setup_t *setup){
-	BILLACCEPTOR_clear_data();
-	// Send command
 	uint16_t cmd[1] = { BILLACCEPTOR_SETUP };
-	BILLACCEPTOR_send_data(cmd, 1);
-	// Wait for get response
-	uint16_t res[28];
-	size_t res_size = sizeof(res)/sizeof(uint16_t);
-	if(!BILLACCEPTOR_receive_response(res, res_size)){
-		return false;
-	}
-	// Validate checksum
-	if(BILLACCEPTOR_calculate_chk(res, res_size-1) != (uint8_t)res[res_size-1]){
-		return false;
-	}
-	BILLACCEPTOR_send_ack();
-	setup->feature_level = res[0];
-	setup->currency_code[0] = res[1];
-	setup->currency_code[1] = res[2];
-	setup->scaling_factor[0] = res[3];
-	setup->scaling_factor[1] = res[4];
-	setup->decimal_place = res[5];
-	setup->stacker_capacity[0] = res[6];
-	setup->stacker_capacity[1] = res[7];
-	setup->security_level[0] = res[8];
-	setup->security_level[1] = res[9];
-	setup->escrow = res[10];
-	memcpy(setup->type_credit, &res[11], 16);
-	return true;
+	return BILLACCEPTOR_queue(cmd, 1, setup);
 }
 
 bool BILLACCEPTOR_security(BILLACCEPTOR_Security_t * security){
-	BILLACCEPTOR_clear_data();
-	// Send command
 	uint16_t cmd[3];
 	cmd[0] = BILLACCEPTOR_SECURITY;
 	cmd[1] = security->bill_type >> 8;
 	cmd[2] = security->bill_type & 0xFF;
-	BILLACCEPTOR_send_data(cmd, 3);
-	// Wait for get response
-	uint16_t code;
-	if(!BILLACCEPTOR_receive_response(&code, 1)){
-		return false;
-	}
-	if(!BILLACCEPTOR_is_res_ack(code)){
-		return false;
-	}
-	return true;
+	return BILLACCEPTOR_queue(cmd, 3, NULL);
 }
 
-bool BILLACCEPTOR_poll(BILLACCEPTOR_Poll_t * poll){
-	BILLACCEPTOR_clear_data();
-	// Send command
+bool BILLACCEPTOR_poll(BILLACCEPTOR_PollEvents_t * poll){
 	uint16_t cmd[1] = {BILLACCEPTOR_POLL};
-	BILLACCEPTOR_send_data(cmd, 1);
-	// Wait for get response
-	uint16_t res[17];
-	size_t expected_res_size = sizeof(res)/sizeof(uint16_t);
-	size_t real_res_size = 0;
-	if(!BILLACCEPTOR_receive_response_timeout(res, expected_res_size, &real_res_size, 50)){
-		return false;
-	}
-	if(real_res_size == 0){
-		return false;
-	}
-	// Validate checksum
-	if(BILLACCEPTOR_calculate_chk(res, real_res_size-1) != (uint8_t)res[real_res_size-1]){
-		return false;
-	}
-	BILLACCEPTOR_send_ack();
-	poll->type = 0xFF;
-	if((res[0] >> 7) & 0x01){
-		// BillAccptec Type
-		poll->BillAccepted.bill_routing = (res[0] >> 4) & 0x07;
-		poll->BillAccepted.bill_type = res[0] & 0x0F;
-		poll->type = IS_BILLACCEPTED;
-	}else{
-		// Status Type
-		poll->Status.status = res[0];
-		poll->type = IS_STATUS;
-	}
-	return true;
+	return BILLACCEPTOR_queue(cmd, 1, poll);
 }
 
 bool BILLACCEPTOR_billtype(BILLACCEPTOR_BillType_t * billtype){
-	BILLACCEPTOR_clear_data();
-	// Send command
 	uint16_t cmd[5];
 	cmd[0] = BILLACCEPTOR_BILLTYPE;
 	cmd[1] = billtype->bill_enable >> 8;
 	cmd[2] = billtype->bill_enable & 0xFF;
 	cmd[3] = billtype->bill_escrow_enable >> 8;
 	cmd[4] = billtype->bill_escrow_enable & 0xFF;
-	BILLACCEPTOR_send_data(cmd, 5);
-	// Wait for get response
-	uint16_t code;
-	if(!BILLACCEPTOR_receive_response(&code, 1)){
-		return false;
-	}
-	if(!BILLACCEPTOR_is_res_ack(code)){
-		return false;
-	}
-	return true;
+	return BILLACCEPTOR_queue(cmd, 5, NULL);
 }
 
 bool BILLACCEPTOR_escrow(BILLACCEPTOR_Escrow_t * escrow){
-	BILLACCEPTOR_clear_data();
-	// Send command
 	uint16_t cmd[2];
 	cmd[0] = BILLACCEPTOR_ESCROW;
 	cmd[1] = escrow->escrow_status;
-	BILLACCEPTOR_send_data(cmd, 2);
-	// Wait for get response
-	uint16_t code;
-	if(!BILLACCEPTOR_receive_response(&code, 1)){
-		return false;
-	}
-	if(!BILLACCEPTOR_is_res_ack(code)){
-		return false;
-	}
-
-	return true;
+	return BILLACCEPTOR_queue(cmd, 2, NULL);
 }
 
 bool BILLACCEPTOR_stacker(BILLACCEPTOR_Stacker_t * stacker){
-	BILLACCEPTOR_clear_data();
-	// Send command
 	uint16_t cmd[1] = {BILLACCEPTOR_STACKER};
-	BILLACCEPTOR_send_data(cmd, 1);
-	// Wait for get response
-	uint16_t res[3];
-	size_t res_size = sizeof(res)/sizeof(uint16_t);
-	if(!BILLACCEPTOR_receive_response(res, res_size)){
-		return false;
-	}
-	// Validate checksum
-	if(BILLACCEPTOR_calculate_chk(res, res_size-1) != (uint8_t)res[res_size-1]){
-		return false;
-	}
-	BILLACCEPTOR_send_ack();
-	if((res[0] >> 7)){
-		// Stacker is full
-		stacker->is_full = 1;
-		stacker->number_of_bills = (uint16_t)(res[0] & 0x7F) << 8 | (res[1] & 0xFF);
-	}else{
-		// Status Type
-		stacker->is_full = 0;
-	}
-	return true;
+	return BILLACCEPTOR_queue(cmd, 1, stacker);
 }
 
 bool BILLACCEPTOR_expansion_cmd(){
@@ -242,59 +180,174 @@ bool BILLACCEPTOR_test(){
 }
 
 bool BILLACCEPTOR_test_2(){
-	BILLACCEPTOR_Poll_t poll;
+	static BILLACCEPTOR_PollEvents_t poll;
 	BILLACCEPTOR_poll(&poll);
 }
 
-static void BILLACCEPTOR_on_1ms_interrupt(){
-	if(billacceptor_timecnt > 0){
-		billacceptor_timecnt--;
-		if(billacceptor_timecnt == 0){
-			billacceptor_timeout_occur = true;
-		}
+static bool BILLACCEPTOR_queue(uint16_t *cmd, size_t cmd_len, void * out){
+	BILLACCEPTOR_Request_t * request;
+	if(queue_len >= BILLACCEPTOR_QUEUE_SIZE){
+		return false;
 	}
+	request = &queue[(queue_head + queue_len) % BILLACCEPTOR_QUEUE_SIZE];
+	memcpy(request->cmd, cmd, cmd_len * sizeof(uint16_t));
+	request->cmd_len = cmd_len;
+	request->out = out;
+	queue_len++;
+	if(engine_state == BILLACCEPTOR_ENGINE_IDLE && wake_cb){
+		wake_cb();
+	}
+	return true;
 }
 
+static void BILLACCEPTOR_start_request(){
+	BILLACCEPTOR_Request_t * request = &queue[queue_head];
+	uint8_t cmd = request->cmd[0];
+	BILLACCEPTOR_clear_data();
+	res_len = 0;
+	BILLACCEPTOR_send_data(request->cmd, request->cmd_len);
+	BILLACCEPTOR_start_timeout(cmd == BILLACCEPTOR_POLL ? BILLACCEPTOR_POLL_TIMEOUT : BILLACCEPTOR_RES_TIMEOUT);
+	engine_state = BILLACCEPTOR_ENGINE_WAIT_RESPONSE;
+}
 
-static bool BILLACCEPTOR_receive_response_timeout(uint16_t *data, size_t expected_len, size_t * real_len, uint16_t timeout){
-	size_t res_len = 0;
-	billacceptor_timecnt = timeout;
-	billacceptor_timeout_occur = false;
-	while(1){
-		if(billacceptor_timeout_occur){
-			break;
-		}
-		if(UART_receive_available(BILLACCEPTOR_UART)){
-			data[res_len++] = UART_receive_data(BILLACCEPTOR_UART);
-			if(res_len == expected_len){
-				break;
-			}
+/**
+ * The UART delivers the response as one frame, cut on the mode bit the
+ * validator sets on its last byte
+ */
+static void BILLACCEPTOR_wait_response(){
+	uint8_t cmd = queue[queue_head].cmd[0];
+	if(UART_receive_frame(BILLACCEPTOR_UART, res_buf, &res_len)){
+		if(res_len == 0 || res_len > res_len_table[cmd - BILLACCEPTOR_RESET]){
+			BILLACCEPTOR_complete(BILLACCEPTOR_RESULT_CHK_ERROR);
+		}else{
+			BILLACCEPTOR_complete(BILLACCEPTOR_parse_response(&queue[queue_head]));
 		}
+		return;
+	}
+	if(timeout){
+		BILLACCEPTOR_complete(BILLACCEPTOR_RESULT_TIMEOUT);
 	}
-	*real_len = res_len;
-	UART_clear_buffer(BILLACCEPTOR_UART);
-	return true;
 }
 
-static bool BILLACCEPTOR_receive_response(uint16_t *data, size_t data_len){
-	bool success = false;
-	size_t res_len = 0;
-	billacceptor_timecnt = BILLACCEPTOR_RES_TIMEOUT;
-	billacceptor_timeout_occur = false;
-	while(1){
-		if(billacceptor_timeout_occur){
-			break;
+static void BILLACCEPTOR_complete(BILLACCEPTOR_Result_t result){
+	uint8_t cmd = queue[queue_head].cmd[0];
+	SCH_Delete_Task(timeout_task_id);
+	timeout_task_id = NO_TASK_ID;
+	BILLACCEPTOR_clear_data();
+	queue_head = (queue_head + 1) % BILLACCEPTOR_QUEUE_SIZE;
+	queue_len--;
+	engine_state = BILLACCEPTOR_ENGINE_IDLE;
+	if(done_cb){
+		done_cb(cmd, result);
+	}
+}
+
+static BILLACCEPTOR_Result_t BILLACCEPTOR_parse_response(BILLACCEPTOR_Request_t * request){
+	uint8_t cmd = request->cmd[0];
+	if(res_len == 1){
+		// Single byte is ACK/NAK, a POLL without event answers ACK
+		if(!BILLACCEPTOR_is_res_ack(res_buf[0])){
+			return BILLACCEPTOR_RESULT_NAK;
 		}
-		if(UART_receive_available(BILLACCEPTOR_UART)){
-			data[res_len++] = UART_receive_data(BILLACCEPTOR_UART);
-			if(res_len == data_len){
-				success = true;
-				break;
+		if(cmd == BILLACCEPTOR_POLL){
+			BILLACCEPTOR_parse_poll(request->out, 0);
+		}
+		return BILLACCEPTOR_RESULT_OK;
+	}
+	// Data response, validate checksum
+	if(BILLACCEPTOR_calculate_chk(res_buf, res_len-1) != (uint8_t)res_buf[res_len-1]){
+		return BILLACCEPTOR_RESULT_CHK_ERROR;
+	}
+	BILLACCEPTOR_send_ack();
+	switch (cmd) {
+		case BILLACCEPTOR_SETUP:
+			if(res_len < res_len_table[BILLACCEPTOR_SETUP - BILLACCEPTOR_RESET]){
+				return BILLACCEPTOR_RESULT_CHK_ERROR;
 			}
+			BILLACCEPTOR_parse_setup(request->out);
+			break;
+		case BILLACCEPTOR_POLL:
+			// Every byte before the checksum is an event
+			BILLACCEPTOR_parse_poll(request->out, res_len - 1);
+			break;
+		case BILLACCEPTOR_STACKER:
+			BILLACCEPTOR_parse_stacker(request->out);
+			break;
+		default:
+			break;
+	}
+	return BILLACCEPTOR_RESULT_OK;
+}
+
+static void BILLACCEPTOR_parse_setup(BILLACCEPTOR_Setup_t *setup){
+	setup->feature_level = res_buf[0];
+	setup->currency_code[0] = res_buf[1];
+	setup->currency_code[1] = res_buf[2];
+	setup->scaling_factor[0] = res_buf[3];
+	setup->scaling_factor[1] = res_buf[4];
+	setup->decimal_place = res_buf[5];
+	setup->stacker_capacity[0] = res_buf[6];
+	setup->stacker_capacity[1] = res_buf[7];
+	setup->security_level[0] = res_buf[8];
+	setup->security_level[1] = res_buf[9];
+	setup->escrow = res_buf[10];
+	for (int var = 0; var < 16; ++var) {
+		setup->type_credit[var] = res_buf[11 + var];
+	}
+}
+
+static void BILLACCEPTOR_parse_poll(BILLACCEPTOR_PollEvents_t * poll, size_t event_count){
+	BILLACCEPTOR_Poll_t * event;
+	uint8_t data;
+	if(event_count > BILLACCEPTOR_POLL_EVENT_MAX){
+		event_count = BILLACCEPTOR_POLL_EVENT_MAX;
+	}
+	for (int var = 0; var < event_count; ++var) {
+		event = &poll->events[var];
+		data = res_buf[var];
+		if((data >> 7) & 0x01){
+			// BillAccptec Type
+			event->BillAccepted.bill_routing = (data >> 4) & 0x07;
+			event->BillAccepted.bill_type = data & 0x0F;
+			event->type = IS_BILLACCEPTED;
+		}else{
+			// Status Type
+			event->Status.status = data;
+			event->type = IS_STATUS;
 		}
 	}
-	UART_clear_buffer(BILLACCEPTOR_UART);
-	return success;
+	poll->event_count = event_count;
+}
+
+static void BILLACCEPTOR_parse_stacker(BILLACCEPTOR_Stacker_t * stacker){
+	if(((uint8_t)res_buf[0] >> 7)){
+		// Stacker is full
+		stacker->is_full = 1;
+		stacker->number_of_bills = (uint16_t)(res_buf[0] & 0x7F) << 8 | (res_buf[1] & 0xFF);
+	}else{
+		// Status Type
+		stacker->is_full = 0;
+	}
+}
+
+static void BILLACCEPTOR_timeout(){
+	timeout = true;
+	if(wake_cb){
+		wake_cb();
+	}
+}
+
+static void BILLACCEPTOR_start_timeout(uint32_t duration){
+	timeout = false;
+	if(!SCH_Reschedule(timeout_task_id, duration)){
+		timeout_task_id = SCH_Add_Task_Priority(BILLACCEPTOR_timeout, duration, 0, SCH_PRIORITY_DEVICE);
+	}
+}
+
+static void BILLACCEPTOR_on_rx(){
+	if(engine_state == BILLACCEPTOR_ENGINE_WAIT_RESPONSE && wake_cb){
+		wake_cb();
+	}
 }
 
 static bool BILLACCEPTOR_is_res_ack(uint16_t code){
@@ -12,8 +12,7 @@
 #include "Hal/i2c.h"
 
 #define EEPROM_ADDRESS	0xA0
-#define EEPROM_ADDRESS_SIZE	4
-#define PAGE_SIZE	32	// 32 bytes
+#define EEPROM_ADDRESS_SIZE	I2C_MEMADD_SIZE_16BIT
 
 enum {
 	EEPROM_READ_OP,
@@ -21,38 +20,60 @@ enum {
 	EEPROM_ERASE_OP
 };
 
-static uint8_t i2c_buffer_wr[PAGE_SIZE];
-static uint8_t i2c_buffer_rd[PAGE_SIZE];
-
 
 bool EEPROM_init(){
-	return true;
+	// Fast mode, and the write cycle is waited by polling the address instead of a fixed delay
+	return I2C_set_device_flags(EEPROM_ADDRESS, I2C_FAST | I2C_ACK_POLL);
 }
 
+/**
+ * Read after the writes still queued
+ */
 bool EEPROM_read(uint16_t _address , uint8_t * data, size_t data_len){
-	I2C_mem_read(EEPROM_ADDRESS, _address, EEPROM_ADDRESS_SIZE, data, data_len);
-	return true;
+	return I2C_mem_read(EEPROM_ADDRESS, _address, EEPROM_ADDRESS_SIZE, data, data_len);
 }
 
+/**
+ * Queue the page writes and return, the data is copied
+ */
+
 bool EEPROM_write(uint16_t _address, uint8_t * data, size_t data_len){
+	return EEPROM_write_cb(_address, data, data_len, NULL, NULL);
+}
+
+/**
+ * Same as EEPROM_write, cb tells when the data is in the EEPROM
+ */
+bool EEPROM_write_cb(uint16_t _address, uint8_t * data, size_t data_len, EEPROM_cb cb, void * arg){
 	uint16_t address;
 	size_t remain_size = data_len;
 	size_t write_size;
 	for(;remain_size > 0;){
-		if(remain_size > PAGE_SIZE){
-			write_size = PAGE_SIZE;
-		}else{
+		address = _address + data_len - remain_size;
+		// Stop at the end of the page, the EEPROM would wrap to its start
+		write_size = EEPROM_PAGE_SIZE - address % EEPROM_PAGE_SIZE;
+		if(write_size > remain_size){
 			write_size = remain_size;
 		}
-		address = _address + data_len - remain_size;
-		memcpy(i2c_buffer_wr , &data[data_len - remain_size], write_size);
-		I2C_mem_write(EEPROM_ADDRESS, address, EEPROM_ADDRESS_SIZE,  i2c_buffer_wr, write_size);
-		HAL_Delay(5);
+		// Wait for room only when the queue is full. The pages go out in order,
+		// the last one tells the caller. I2C_poll ends a stuck transaction after
+		// I2C_TIMEOUT, also from the PVD interrupt where the tick is stopped
+		while(!I2C_mem_write_async(EEPROM_ADDRESS, address, EEPROM_ADDRESS_SIZE, &data[data_len - remain_size], write_size,
+				write_size == remain_size ? cb : NULL, arg)){
+			I2C_poll();
+		}
 		remain_size -= write_size;
 	}
 	return true;
 }
 
+/**
+ * Block until the queued writes are sent
+ */
+void EEPROM_sync(){
+	I2C_wait();
+}
+
 bool EEPROM_test(){
 	// Write
 	uint8_t test_str[100];
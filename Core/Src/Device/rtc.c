@@ -11,35 +11,45 @@
 #include "main.h"
 #include "Device/rtc.h"
 #include "Hal/i2c.h"
+#include "Lib/scheduler/scheduler.h"
 
 #define DS1307_ADDRESS	0x68
+#define RTC_UPDATE_INTERVAL		500		// ms between two reads of the DS1307
 
 
+static void RTC_timeout_for_update();
+static void RTC_on_read(bool success, void * arg);
+static void RTC_decode(uint8_t * data, RTC_t * rtc);
 static uint8_t RTC_dec_to_bcd(uint8_t num);
 static uint8_t RTC_bcd_to_dec(uint8_t num);
 
-void RTC_init(){
+// Time of the last read, RTC_get_time returns it without waiting for the bus
+static RTC_t rtc_time;
+// seconds, minutes, hours, date, date of week, month, year
+static uint8_t read_data[7];
+static volatile bool read_pending = false;
+// Changed by RTC_set_time, a read started before is stale
+static volatile uint32_t rtc_generation = 0;
 
+void RTC_init(){
+	if(I2C_mem_read(DS1307_ADDRESS << 1, 0x00, I2C_MEMADD_SIZE_8BIT, read_data, sizeof(read_data))){
+		RTC_decode(read_data, &rtc_time);
+	}
+	SCH_Add_Task_Priority(RTC_timeout_for_update, RTC_UPDATE_INTERVAL, RTC_UPDATE_INTERVAL, SCH_PRIORITY_DEVICE);
 }
 
 RTC_t RTC_get_time(){
-	RTC_t rtc_time;
-
-	uint8_t write_data[] = { 0x00 };
-	// seconds, minutes, hours, date, date of week, month, year
-	uint8_t read_data[7] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-	I2C_write_and_read(DS1307_ADDRESS << 1, write_data, sizeof(write_data), read_data, sizeof(read_data));
-	rtc_time.second = RTC_bcd_to_dec(read_data[0] & 0x7F);
-	rtc_time.minute = RTC_bcd_to_dec(read_data[1]);
-	rtc_time.hour = RTC_bcd_to_dec(read_data[2] & 0x3F);
-	rtc_time.date = RTC_bcd_to_dec(read_data[4]);
-	rtc_time.month = RTC_bcd_to_dec(read_data[5]);
-	rtc_time.year = RTC_bcd_to_dec(read_data[6]) + 2000;
-	return rtc_time;
+	RTC_t time;
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	time = rtc_time;
+	__set_PRIMASK(primask);
+	return time;
 }
 
 void RTC_set_time(RTC_t *rtc){
 	uint8_t write_data[8];
+	uint32_t primask;
 	// Set time
 	write_data[0] = 0x00;
 	write_data[1] = 0x80;
@@ -49,11 +59,20 @@ void RTC_set_time(RTC_t *rtc){
 	write_data[5] = RTC_dec_to_bcd(rtc->date);
 	write_data[6] = RTC_dec_to_bcd(rtc->month);
 	write_data[7] = RTC_dec_to_bcd(rtc->year - 2000);
-	I2C_write(DS1307_ADDRESS  << 1, write_data, 8);
+	rtc_generation++;
+	while(!I2C_mem_write_async(DS1307_ADDRESS << 1, write_data[0], I2C_MEMADD_SIZE_8BIT, &write_data[1], 7, NULL, NULL)){
+		I2C_poll();
+	}
 	// Reset timer
 	write_data[0] = 0x00;
 	write_data[1] = RTC_dec_to_bcd(rtc->second);
-	I2C_write(DS1307_ADDRESS  << 1, write_data, 2);
+	while(!I2C_mem_write_async(DS1307_ADDRESS << 1, write_data[0], I2C_MEMADD_SIZE_8BIT, &write_data[1], 1, NULL, NULL)){
+		I2C_poll();
+	}
+	primask = __get_PRIMASK();
+	__disable_irq();
+	rtc_time = *rtc;
+	__set_PRIMASK(primask);
 }
 void RTC_test(){
 	RTC_t rtc = {
@@ -71,6 +90,31 @@ void RTC_test(){
 }
 
 
+static void RTC_timeout_for_update(){
+	if(!read_pending){
+		read_pending = I2C_mem_read_async(DS1307_ADDRESS << 1, 0x00, I2C_MEMADD_SIZE_8BIT, read_data, sizeof(read_data),
+				RTC_on_read, (void *)(uintptr_t)rtc_generation);
+	}
+	I2C_poll();
+}
+
+// Called from the I2C interrupt
+static void RTC_on_read(bool success, void * arg){
+	read_pending = false;
+	if(success && (uintptr_t)arg == rtc_generation){
+		RTC_decode(read_data, &rtc_time);
+	}
+}
+
+static void RTC_decode(uint8_t * data, RTC_t * rtc){
+	rtc->second = RTC_bcd_to_dec(data[0] & 0x7F);
+	rtc->minute = RTC_bcd_to_dec(data[1]);
+	rtc->hour = RTC_bcd_to_dec(data[2] & 0x3F);
+	rtc->date = RTC_bcd_to_dec(data[4]);
+	rtc->month = RTC_bcd_to_dec(data[5]);
+	rtc->year = RTC_bcd_to_dec(data[6]) + 2000;
+}
+
 static uint8_t RTC_dec_to_bcd(uint8_t num){
 	return ((num/10 * 16) + (num % 10));
 }
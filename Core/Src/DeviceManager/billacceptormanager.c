@@ -10,10 +10,10 @@
 #include "Device/billacceptor.h"
 #include "Device/eeprom.h"
 #include "Device/lcd.h"
-
+#include "App/eventbus.h"
+#include "Lib/scheduler/scheduler.h"
 #include "Lib/utils/utils_logger.h"
 #define EEPROM_AMOUNT_ADDRESS		0x01
-#define POLL_INTERVAL				200	//200ms
 
 /**
  * Bill Type
@@ -56,7 +56,12 @@ static BILLACCEPTOR_Security_t security = {
 	.bill_type = 0x0000
 };
 
-static BILLACCEPTOR_Poll_t poll;
+static BILLACCEPTOR_PollEvents_t poll;
+// Next event of the last POLL to consume
+static uint8_t poll_event_index = 0;
+static BILLACCEPTOR_Setup_t setup;
+static bool poll_pending = false;
+static BILLACCEPTORMNG_stats_t stats;
 
 // BillType Mapping
 static uint32_t bill_mapping[] = {
@@ -89,28 +94,42 @@ static const char * bill_status_name[] = {
 
 static void BILLACCEPTORMNG_status_printf(uint8_t bill_status);
 
-static bool timeout = true;
+static bool timeout = false;
+static uint32_t poll_task_id = NO_TASK_ID;
+static uint32_t poll_interval = BILLACCEPTORMNG_POLL_FAST;
+static uint32_t poll_start_ticks = 0;
 
 // Private function
 static void BILLACCEPTORMNG_idle();
+static void BILLACCEPTORMNG_handle_event(BILLACCEPTOR_Poll_t * event);
 static void BILLACCEPTORMNG_have_bill();
 static void BILLACCEPTORMNG_status();
 static void BILLACCEPTORMNG_timeout();
+static void BILLACCEPTORMNG_start_poll_timeout(uint32_t duration);
+static bool BILLACCEPTORMNG_poll();
+static void BILLACCEPTORMNG_update_poll_interval(BILLACCEPTOR_Result_t result);
+static void BILLACCEPTORMNG_on_done(uint8_t cmd, BILLACCEPTOR_Result_t result);
+static void BILLACCEPTORMNG_on_wake();
 static void BILLACCEPTOR_save_amount_to_eeprom(uint32_t amount, uint32_t _total_amount);
 
 bool BILLACCEPTORMNG_init(){
 	CONFIG_t * config = CONFIG_get();
 	amount = config->amount;
+	BILLACCEPTOR_set_done_callback(BILLACCEPTORMNG_on_done);
+	BILLACCEPTOR_set_wake_callback(BILLACCEPTORMNG_on_wake);
+	// Start up sequence, sent from BILLACCEPTORMNG_run
 	BILLACCEPTOR_reset();
-	BILLACCEPTOR_Poll_t poll;
-	BILLACCEPTOR_poll(&poll);
-	BILLACCEPTOR_Setup_t setup;
+	poll.event_count = 0;
+	BILLACCEPTORMNG_poll();
 	BILLACCEPTOR_setup(&setup);
 	BILLACCEPTOR_security(&security);
 	BILLACCEPTOR_billtype(&billtype_default);
+	// The next POLL is scheduled when the current one completes
 }
 
 bool BILLACCEPTORMNG_run(){
+	// Responses complete in BILLACCEPTORMNG_on_done
+	BILLACCEPTOR_run();
 	switch (billacceptormng_state) {
 		case BILLACCEPTORMNG_IDLE:
 			BILLACCEPTORMNG_idle();
@@ -124,6 +143,9 @@ bool BILLACCEPTORMNG_run(){
 		default:
 			break;
 	}
+	if(billacceptormng_state != BILLACCEPTORMNG_IDLE || poll_event_index < poll.event_count){
+		EVENTBUS_post(EVENT_BILLACCEPTOR);
+	}
 }
 
 uint8_t BILLACCEPTORMNG_get_state(){
@@ -135,7 +157,7 @@ uint8_t BILLACCEPTORMNG_get_status(){
 }
 
 void BILLACCEPTORMNG_disable(){
-	BILLACCEPTOR_BillType_t billtype = {
+	static BILLACCEPTOR_BillType_t billtype = {
 		.bill_enable = 0x00,
 		.bill_enable = 0x00
 	};
@@ -146,12 +168,31 @@ void BILLACCEPTORMNG_disable(){
 void BILLACCEPTORMNG_enable(){
 	BILLACCEPTOR_billtype(&billtype_default);
 	is_enable = true;
+	BILLACCEPTORMNG_notify_activity();
 }
 
 bool BILLACCEPTORMNG_is_enabled(){
 	return is_enable;
 }
 
+void BILLACCEPTORMNG_get_stats(BILLACCEPTORMNG_stats_t * _stats){
+	stats.poll_interval = poll_interval;
+	*_stats = stats;
+}
+
+/**
+ * Input from the customer (key, card...), poll fast right away
+ */
+void BILLACCEPTORMNG_notify_activity(){
+	if(poll_interval == BILLACCEPTORMNG_POLL_FAST){
+		return;
+	}
+	poll_interval = BILLACCEPTORMNG_POLL_FAST;
+	if(!poll_pending){
+		BILLACCEPTORMNG_start_poll_timeout(0);
+	}
+}
+
 bool BILLACCEPTORMNG_is_error(){
 	return (billacceptor_status != STATUS_SUCCESS);
 }
@@ -186,27 +227,39 @@ void BILLACCEPTORMNG_test(){
 
 // Private function
 static void BILLACCEPTORMNG_idle(){
-	if(timeout){
+	// Consume the events of the last POLL in order, one per pass
+	if(poll_event_index < poll.event_count){
+		BILLACCEPTORMNG_handle_event(&poll.events[poll_event_index++]);
+		return;
+	}
+	// One POLL on the link at a time, the result comes in BILLACCEPTORMNG_on_done
+	if(timeout && !poll_pending){
 		timeout = false;
 		// Call Polling BillAcceptor
-		memset(&poll, 0xFF, sizeof(BILLACCEPTOR_Poll_t));
-		BILLACCEPTOR_poll(&poll);
-		switch (poll.type) {
-			case IS_BILLACCEPTED:
-				bill_type_accepted = poll.BillAccepted.bill_type;
-				bill_routing = poll.BillAccepted.bill_routing;
-				billacceptormng_state = BILLACCEPTORMNG_HAVE_BILL;
-				break;
-			case IS_STATUS:
-				billacceptor_status = poll.Status.status;
-				billacceptormng_state = BILLACCEPTORMNG_STATUS;
-				break;
-			default:
-				break;
+		if(!BILLACCEPTORMNG_poll()){
+			// Queue full, try again later
+			BILLACCEPTORMNG_start_poll_timeout(poll_interval);
 		}
-		SCH_Add_Task(BILLACCEPTORMNG_timeout, POLL_INTERVAL, 0);
 	}
+}
 
+static void BILLACCEPTORMNG_handle_event(BILLACCEPTOR_Poll_t * event){
+	switch (event->type) {
+		case IS_BILLACCEPTED:
+			bill_type_accepted = event->BillAccepted.bill_type;
+			bill_routing = event->BillAccepted.bill_routing;
+			billacceptormng_state = BILLACCEPTORMNG_HAVE_BILL;
+			break;
+		case IS_STATUS:
+			if(billacceptor_status != event->Status.status){
+				EVENTBUS_post(EVENT_STATUS_CHANGED);
+			}
+			billacceptor_status = event->Status.status;
+			billacceptormng_state = BILLACCEPTORMNG_STATUS;
+			break;
+		default:
+			break;
+	}
 }
 
 static void BILLACCEPTORMNG_have_bill(){
@@ -228,6 +281,8 @@ static void BILLACCEPTORMNG_have_bill(){
 		case BILL_ESCROW_POSITION:
 			utils_log_info("Billacceptor escrow\r\n");
 			BILLACCEPTOR_escrow(&escrow);
+			// The stacked event follows shortly
+			BILLACCEPTORMNG_notify_activity();
 			break;
 		case BILL_RETURNED:
 			utils_log_info("Bill returned\r\n");
@@ -253,6 +308,91 @@ static void BILLACCEPTORMNG_status(){
 
 static void BILLACCEPTORMNG_timeout(){
 	timeout = true;
+	EVENTBUS_post(EVENT_BILLACCEPTOR);
+}
+
+static void BILLACCEPTORMNG_on_done(uint8_t cmd, BILLACCEPTOR_Result_t result){
+	if(cmd == BILLACCEPTOR_POLL){
+		poll_pending = false;
+		BILLACCEPTORMNG_update_poll_interval(result);
+		BILLACCEPTORMNG_start_poll_timeout(poll_interval);
+	}
+	if(result != BILLACCEPTOR_RESULT_OK){
+		utils_log_error("BillAcceptor command %x failed %d\r\n", cmd, result);
+		return;
+	}
+	if(cmd != BILLACCEPTOR_POLL){
+		return;
+	}
+	stats.poll_count++;
+	stats.event_count += poll.event_count;
+	if(poll.event_count > 1){
+		stats.multi_event_poll_count++;
+	}
+	if(poll.event_count > stats.max_events_per_poll){
+		stats.max_events_per_poll = poll.event_count;
+	}
+	if(poll.event_count == 0){
+		// ACK, nothing to report: the validator is fine
+		poll.events[0].type = IS_STATUS;
+		poll.events[0].Status.status = STATUS_SUCCESS;
+		poll.event_count = 1;
+	}
+	poll_event_index = 0;
+}
+
+static void BILLACCEPTORMNG_start_poll_timeout(uint32_t duration){
+	timeout = false;
+	if(!SCH_Reschedule(poll_task_id, duration)){
+		poll_task_id = SCH_Add_Task_Priority(BILLACCEPTORMNG_timeout, duration, 0, SCH_PRIORITY_DEVICE);
+	}
+}
+
+static bool BILLACCEPTORMNG_poll(){
+	poll_pending = BILLACCEPTOR_poll(&poll);
+	if(poll_pending){
+		poll_start_ticks = SCH_Get_Ticks();
+		if(poll_interval == BILLACCEPTORMNG_POLL_FAST){
+			stats.fast_poll_count++;
+		}
+	}
+	return poll_pending;
+}
+
+/**
+ * Back to the fast interval after any event but "disabled" (some validators
+ * repeat it on every POLL), double the interval after a quiet POLL.
+ */
+static void BILLACCEPTORMNG_update_poll_interval(BILLACCEPTOR_Result_t result){
+	uint32_t response_time = SCH_Get_Ticks() - poll_start_ticks;
+	bool active = false;
+	if(result != BILLACCEPTOR_RESULT_OK){
+		stats.no_response_count++;
+	}else{
+		stats.response_time_total += response_time;
+		if(response_time > stats.response_time_max){
+			stats.response_time_max = response_time;
+		}
+		for (int var = 0; var < poll.event_count; ++var) {
+			if(poll.events[var].type != IS_STATUS
+					|| poll.events[var].Status.status != STATUS_VALIDATOR_DISABLE){
+				active = true;
+			}
+		}
+	}
+	if(active){
+		poll_interval = BILLACCEPTORMNG_POLL_FAST;
+	}else if(poll_interval < BILLACCEPTORMNG_POLL_SLOW){
+		poll_interval *= 2;
+		if(poll_interval > BILLACCEPTORMNG_POLL_SLOW){
+			poll_interval = BILLACCEPTORMNG_POLL_SLOW;
+		}
+	}
+}
+
+// Called from the UART interrupt or the response timeout
+static void BILLACCEPTORMNG_on_wake(){
+	EVENTBUS_post(EVENT_BILLACCEPTOR);
 }
 
 static void BILLACCEPTOR_save_amount_to_eeprom(uint32_t _amount, uint32_t _total_amount){
@@ -264,7 +404,9 @@ static void BILLACCEPTOR_save_amount_to_eeprom(uint32_t _amount, uint32_t _total
 
 
 static void BILLACCEPTORMNG_status_printf(uint8_t bill_status){
-	if(bill_status == STATUS_SUCCESS){
+	if(bill_status > STATUS_NB_ATTEMP_INPUT_BILL){
+		utils_log_error("STATUS %x\r\n", bill_status);
+	}else if(bill_status == STATUS_SUCCESS){
 		utils_log_info(bill_status_name[bill_status]);
 	}else{
 		utils_log_error(bill_status_name[bill_status]);
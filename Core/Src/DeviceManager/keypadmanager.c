@@ -8,6 +8,7 @@
 
 #include "DeviceManager/keypadmanager.h"
 #include "Device/keypad.h"
+#include "App/eventbus.h"
 #include "Lib/scheduler/scheduler.h"
 #include "Lib/utils/utils_logger.h"
 
@@ -46,7 +47,7 @@ static bool KEYPADMNG_is_release(uint16_t keypad_status, uint16_t keypad_prev_st
 static void KEYPADMNG_timeout_for_debounce();
 
 void KEYPADMNG_init(){
-
+	SCH_Add_Task_Priority(KEYPADMNG_timeout_for_debounce, DEBOUNCE_TIME, DEBOUNCE_TIME, SCH_PRIORITY_DEVICE);
 }
 
 void KEYPADMNG_run(){
@@ -67,11 +68,17 @@ void KEYPADMNG_run(){
 			KEYPADMNG_enter_btn_run();
 			// Cancel button run state
 			KEYPADMNG_cancel_btn_run();
+			// Wake the keypad handler on key change and while a key is held (long press)
+			if(keypad_status != keypad_prev_status || keypad_status != 0){
+				EVENTBUS_post(EVENT_KEYPADHANDLER);
+			}
+			if(keypad_status != keypad_prev_status){
+				EVENTBUS_post(EVENT_INPUT);
+			}
 			// Update keypad status
 			keypad_prev_status = keypad_status;
 		}
 		keypad_status_debounce = keypad_status;
-		SCH_Add_Task(KEYPADMNG_timeout_for_debounce, DEBOUNCE_TIME, 0);
 	}
 }
 
@@ -202,4 +209,5 @@ static bool KEYPADMNG_is_release(uint16_t keypad_status, uint16_t keypad_prev_st
 
 static void KEYPADMNG_timeout_for_debounce(){
 	timeout_for_debounce = true;
+	EVENTBUS_post(EVENT_KEYPAD);
 }
@@ -8,6 +8,7 @@
 #include "main.h"
 #include "DeviceManager/lcdmanager.h"
 #include "Device/rtc.h"
+#include "App/eventbus.h"
 #include "Lib/scheduler/scheduler.h"
 #include "Lib/utils/utils_logger.h"
 
@@ -89,6 +90,7 @@ static void LCDMNG_blink();
 static void LCDMNG_set_blink(size_t x_position, size_t line_position);
 static void LCDMNG_clear_blink();
 static void LCDMNG_timeout();
+static void LCDMNG_start_timeout(uint32_t duration);
 static void LCDMNG_timeout_for_blink();
 static void LCDMNG_printf();
 static void LCDMNG_draw_string(uint8_t *buff, uint8_t x, uint8_t line, uint8_t *c);
@@ -1100,6 +1102,7 @@ static uint32_t timeout_task_id;
 // For blink
 static bool timeout = false;
 static bool timeout_for_blink = false;
+static uint32_t blink_task_id = NO_TASK_ID;
 static size_t blink_x_position;
 static size_t blink_line_position;
 static bool blink_enable = false;
@@ -1172,12 +1175,15 @@ void LCDMNG_run(){
 			break;
 	}
 	LCDMNG_printf();
+	if(prev_state != state){
+		EVENTBUS_post(EVENT_LCD);
+	}
 	prev_state = state;
 }
 
 static void LCDMNG_state_init(){
 	LCD_draw_bitmap(logo_screen);
-	timeout_task_id = SCH_Add_Task(LCDMNG_timeout, INIT_SCREEN_DURATION, 0);
+	LCDMNG_start_timeout(INIT_SCREEN_DURATION);
 	state = LCDMNG_STATE_WAIT_FOR_INIT;
 }
 
@@ -1190,7 +1196,7 @@ static void LCDMNG_state_wait_for_init(){
 static void LCDMNG_state_welcome(){
 	LCD_draw_bitmap(welcome_screen);
 	timeout = false;
-	timeout_task_id = SCH_Add_Task(LCDMNG_timeout, WELCOME_SCREEN_DURATION, 0);
+	LCDMNG_start_timeout(WELCOME_SCREEN_DURATION);
 	state = LCDMNG_STATE_WAIT_FOR_WELCOME;
 }
 
@@ -1198,7 +1204,7 @@ static void LCDMNG_state_wait_for_welcome(){
 	if(timeout){
 		timeout = false;
 		LCD_draw_bitmap(working_screen_temp);
-		timeout_task_id = SCH_Add_Task(LCDMNG_timeout, WORKING_SCREEN_DURATION, 0);
+		LCDMNG_start_timeout(WORKING_SCREEN_DURATION);
 		state = LCDMNG_STATE_WORKING;
 	}
 }
@@ -1216,26 +1222,26 @@ static void LCDMNG_state_working(){
 			timeout = false;
 			curr_screen = card_error_screen;
 			LCD_draw_bitmap(card_error_screen);
-			timeout_task_id = SCH_Add_Task(LCDMNG_timeout, CARD_ERROR_SCREEN_DURATION, 0);
+			LCDMNG_start_timeout(CARD_ERROR_SCREEN_DURATION);
 			state = LCDMNG_STATE_CARD_ERROR;
 		}
 		else if(card_empty_enable){
 			timeout = false;
 			curr_screen = card_empty_screen;
 			LCD_draw_bitmap(card_empty_screen);
-			timeout_task_id = SCH_Add_Task(LCDMNG_timeout, CARD_EMPTY_SCREEN_DURATION, 0);
+			LCDMNG_start_timeout(CARD_EMPTY_SCREEN_DURATION);
 			state = LCDMNG_STATE_CARD_EMPTY;
 		}
 		else if(card_lower_enable){
 			timeout = false;
 			curr_screen = card_lower_screen;
 			LCD_draw_bitmap(card_lower_screen);
-			timeout_task_id = SCH_Add_Task(LCDMNG_timeout, CARD_LOWER_SCREEN_DURATION, 0);
+			LCDMNG_start_timeout(CARD_LOWER_SCREEN_DURATION);
 			state = LCDMNG_STATE_CARD_LOWER;
 		}else if(idle_enable){
 			timeout = false;
 			LCD_draw_bitmap(logo_screen);
-			timeout_task_id = SCH_Add_Task(LCDMNG_timeout, IDLE_SCREEN_DURATION, 0);
+			LCDMNG_start_timeout(IDLE_SCREEN_DURATION);
 			state = LCDMNG_STATE_IDLE;
 		}
 	}
@@ -1253,8 +1259,7 @@ static void LCDMNG_state_password(){
 		// Switch to Working screen
 		timeout = false;
 		LCD_draw_bitmap(working_screen_temp);
-		SCH_Delete_Task(timeout_task_id);
-		timeout_task_id = SCH_Add_Task(LCDMNG_timeout, WORKING_SCREEN_DURATION, 0);
+		LCDMNG_start_timeout(WORKING_SCREEN_DURATION);
 		state = LCDMNG_STATE_WORKING;
 	}
 }
@@ -1274,8 +1279,7 @@ static void LCDMNG_state_setting(){
 		// Switch to Working screen
 		timeout = false;
 		LCD_draw_bitmap(working_screen_temp);
-		SCH_Delete_Task(timeout_task_id);
-		timeout_task_id = SCH_Add_Task(LCDMNG_timeout, WORKING_SCREEN_DURATION, 0);
+		LCDMNG_start_timeout(WORKING_SCREEN_DURATION);
 		state = LCDMNG_STATE_WORKING;
 	}
 
@@ -1298,7 +1302,7 @@ static void LCDMNG_state_card_lower(){
 		// Draw lower screen -> Switch again to Working
 		LCD_draw_bitmap(working_screen_temp);
 		state = LCDMNG_STATE_WORKING;
-		SCH_Add_Task(LCDMNG_timeout, WORKING_SCREEN_DURATION_WHEN_LOWER_CARD, 0);
+		LCDMNG_start_timeout(WORKING_SCREEN_DURATION_WHEN_LOWER_CARD);
 	}
 }
 
@@ -1307,7 +1311,7 @@ static void LCDMNG_state_card_empty(){
 	if(timeout){
 		timeout = false;
 		state = LCDMNG_STATE_WORKING;
-		timeout_task_id = SCH_Add_Task(LCDMNG_timeout, WORKING_SCREEN_DURATION_WHEN_EMPTY_CARD, 0);
+		LCDMNG_start_timeout(WORKING_SCREEN_DURATION_WHEN_EMPTY_CARD);
 	}
 }
 
@@ -1316,7 +1320,7 @@ static void LCDMNG_state_card_error(){
 	if(timeout){
 		timeout = false;
 		state = LCDMNG_STATE_WORKING;
-		timeout_task_id = SCH_Add_Task(LCDMNG_timeout, WORKING_SCREEN_DURATION_WHEN_ERROR_CARD, 0);
+		LCDMNG_start_timeout(WORKING_SCREEN_DURATION_WHEN_ERROR_CARD);
 	}
 }
 
@@ -1327,7 +1331,7 @@ static void LCDMNG_state_idle(){
 		timeout = false;
 		LCD_draw_bitmap(working_screen_temp);
 		state = LCDMNG_STATE_WORKING;
-		timeout_task_id = SCH_Add_Task(LCDMNG_timeout, WORKING_SCREEN_DURATION, 0);
+		LCDMNG_start_timeout(WORKING_SCREEN_DURATION);
 	}
 }
 
@@ -1336,7 +1340,6 @@ static void LCDMNG_run_blink(){
 		if(timeout_for_blink){
 			LCDMNG_blink();
 			timeout_for_blink = false;
-			SCH_Add_Task(LCDMNG_timeout, BLINK_INTERVAL, 0);
 		}
 	}
 
@@ -1366,10 +1369,15 @@ static void LCDMNG_set_blink(size_t x_position, size_t line_position){
 	blink_x_position = x_position;
 	blink_line_position = line_position;
 	blink_enable = true;
+	if(blink_task_id == NO_TASK_ID){
+		blink_task_id = SCH_Add_Task_Priority(LCDMNG_timeout_for_blink, BLINK_INTERVAL, BLINK_INTERVAL, SCH_PRIORITY_UI);
+	}
 }
 
 static void LCDMNG_clear_blink(){
 	blink_enable = false;
+	SCH_Delete_Task(blink_task_id);
+	blink_task_id = NO_TASK_ID;
 }
 
 void LCDMNG_set_init_screen(){
@@ -1377,6 +1385,7 @@ void LCDMNG_set_init_screen(){
 	if(state != LCDMNG_STATE_INIT && state != LCDMNG_STATE_WAIT_FOR_INIT){
 		state = LCDMNG_STATE_INIT;
 	}
+	EVENTBUS_post(EVENT_LCD);
 }
 
 void LCDMNG_set_working_screen_without_draw(RTC_t * rtc, uint32_t amount){
@@ -1466,10 +1475,12 @@ void LCDMNG_set_password_screen(uint8_t *password, size_t password_len, uint8_t
 	}
 	LCD_draw_bitmap(password_screen);
 	password_enable = true;
+	EVENTBUS_post(EVENT_LCD);
 }
 
 void LCDMNG_clear_password_screen(){
 	password_enable = false;
+	EVENTBUS_post(EVENT_LCD);
 }
 
 void LCDMNG_set_setting_screen(){
@@ -1484,10 +1495,12 @@ void LCDMNG_set_setting_screen(){
 	// Do nothing with argument
 	LCD_draw_bitmap(setting_screen);
 	setting_enable = true;
+	EVENTBUS_post(EVENT_LCD);
 }
 
 void LCDMNG_clear_setting_screen(){
 	setting_enable = false;
+	EVENTBUS_post(EVENT_LCD);
 }
 
 void LCDMNG_set_setting_data_screen(uint32_t field_id, void * data, size_t data_len, uint8_t state){
@@ -1527,10 +1540,12 @@ void LCDMNG_set_setting_data_screen(uint32_t field_id, void * data, size_t data_
 	}
 	LCD_draw_bitmap(setting_data_screen);
 	setting_data_enable = true;
+	EVENTBUS_post(EVENT_LCD);
 }
 
 void LCDMNG_clear_setting_data_screen(){
 	setting_data_enable = false;
+	EVENTBUS_post(EVENT_LCD);
 }
 
 void LCDMNG_set_card_lower_screen(){
@@ -1737,11 +1752,21 @@ static void LCDMNG_draw_char(uint8_t *buff, uint8_t x, uint8_t line, uint8_t c)
 
 static void LCDMNG_timeout(){
 	timeout = true;
+	EVENTBUS_post(EVENT_LCD);
+}
+
+static void LCDMNG_start_timeout(uint32_t duration){
+	timeout = false;
+	// Move the pending screen timeout, add a new one if it already fired
+	if(!SCH_Reschedule(timeout_task_id, duration)){
+		timeout_task_id = SCH_Add_Task_Priority(LCDMNG_timeout, duration, 0, SCH_PRIORITY_UI);
+	}
 }
 
 
 static void LCDMNG_timeout_for_blink(){
 	timeout_for_blink = true;
+	EVENTBUS_post(EVENT_LCD);
 }
 
 static void LCDMNG_printf(){
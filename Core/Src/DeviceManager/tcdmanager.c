@@ -9,6 +9,7 @@
 #include "main.h"
 #include "DeviceManager/tcdmanager.h"
 #include "Device/tcd.h"
+#include "App/eventbus.h"
 #include "Lib/scheduler/scheduler.h"
 #include "Lib/utils/utils_logger.h"
 
@@ -20,6 +21,7 @@
 #define ERROR_CHECK_INTERVAL			3000	// 3s
 #define UPDATING_STATUS_TIME_WHEN_LOWER			5000	//7000s
 #define UPDATING_STATUS_TIME_WHEN_NORMAL		100	//100ms
+#define TCD_STATUS_INTERVAL				100	//100ms
 
 
 
@@ -114,9 +116,14 @@ static void TCD_update_status(TCD_HandleType_t *htcd);
 static bool TCD_is_available(TCD_HandleType_t *htcd);
 static void TCD_timeout_tcd_1();
 static void TCD_timeout_tcd_2();
+static void TCD_timeout_for_status();
+static void TCD_start_timeout(TCD_HandleType_t *htcd, uint32_t duration);
 static void TCD_printf(TCD_HandleType_t *htcd);
+static bool TCD_needs_run(TCD_HandleType_t *htcd);
 
 void TCDMNG_init(){
+	// Refresh the cached sensor status while idle
+	SCH_Add_Task_Priority(TCD_timeout_for_status, TCD_STATUS_INTERVAL, TCD_STATUS_INTERVAL, SCH_PRIORITY_DEVICE);
 }
 
 void TCDMNG_set_take_card_cb(TCDMNG_take_card_cb callback){
@@ -129,6 +136,11 @@ void TCDMNG_set_callback_card_cb(TCDMNG_callback_card_cb callback){
 void TCDMNG_run(){
 	TCD_run(&htcd_1);
 	TCD_run(&htcd_2);
+	// The card sensors are polled while a card goes out and the states set from
+	// outside run at once. The other states wait for their timeout
+	if(TCD_needs_run(&htcd_1) || TCD_needs_run(&htcd_2)){
+		EVENTBUS_post(EVENT_TCD);
+	}
 }
 
 TCDMNG_Status_t TCDMNG_get_status(){
@@ -154,6 +166,7 @@ void TCDMNG_reset(){
 	// Reset both of tcd
 	htcd_1.state = TCD_RESETING;
 	htcd_2.state = TCD_RESETING;
+	EVENTBUS_post(EVENT_TCD);
 }
 
 bool TCDMNG_payout(){
@@ -179,6 +192,7 @@ bool TCDMNG_payout(){
 			return false;
 		}
 	}
+	EVENTBUS_post(EVENT_TCD);
 	return true;
 }
 
@@ -205,26 +219,22 @@ bool TCDMNG_callback(){
 			return false;
 		}
 	}
+	EVENTBUS_post(EVENT_TCD);
 	return true;
 }
 
 
+// Status is read from the GPIOs in TCDMNG_run, these only return the cached value
 bool TCDMNG_is_error(){
-	TCD_update_status(&htcd_1);
-	TCD_update_status(&htcd_2);
 	return (htcd_1.status.is_error) &&
 			(htcd_2.status.is_error);
 }
 
 bool TCDMNG_is_lower(){
-	TCD_update_status(&htcd_1);
-	TCD_update_status(&htcd_2);
 	return (htcd_1.status.is_lower && htcd_2.status.is_lower);
 }
 
 bool TCDMNG_is_empty(){
-	TCD_update_status(&htcd_1);
-	TCD_update_status(&htcd_2);
 	return (htcd_1.status.is_empty && htcd_2.status.is_empty);
 }
 
@@ -234,7 +244,6 @@ bool TCDMNG_is_available_for_use(){
 
 
 static bool TCD_is_available(TCD_HandleType_t *htcd){
-	TCD_update_status(htcd);
 	return (!htcd->status.is_empty &&
 			!htcd->status.is_error);
 }
@@ -285,10 +294,7 @@ static void TCD_run(TCD_HandleType_t *htcd){
 
 static void TCD_idle(TCD_HandleType_t *htcd){
 	if (htcd->status.is_error){
-		SCH_Delete_Task(htcd->timeout_task_id);
-		htcd->timeout = false;
-		void * timeout_func = htcd->id == TCD_1? TCD_timeout_tcd_1 : TCD_timeout_tcd_2;
-		htcd->timeout_task_id = SCH_Add_Task(timeout_func, ERROR_CHECK_INTERVAL, 0);
+		TCD_start_timeout(htcd, ERROR_CHECK_INTERVAL);
 		htcd->state = TCD_ERROR;
 	}
 }
@@ -296,10 +302,7 @@ static void TCD_idle(TCD_HandleType_t *htcd){
 static void TCD_reseting(TCD_HandleType_t *htcd){
 	TCD_reset(htcd->id, true);
 	// How long to enable payout signal
-	SCH_Delete_Task(htcd->timeout_task_id);
-	htcd->timeout = false;
-	void * timeout_func = htcd->id == TCD_1? TCD_timeout_tcd_1 : TCD_timeout_tcd_2;
-	htcd->timeout_task_id = SCH_Add_Task(timeout_func, PAYOUT_DURATION, 0);
+	TCD_start_timeout(htcd, PAYOUT_DURATION);
 	htcd->state = TCD_WAIT_FOR_RESETING;
 }
 
@@ -311,20 +314,14 @@ static void TCD_wait_for_reseting(TCD_HandleType_t *htcd){
 
 static void TCD_payouting(TCD_HandleType_t *htcd){
 	TCD_payout_card(htcd->id, true);
-	SCH_Delete_Task(htcd->timeout_task_id);
-	htcd->timeout = false;
-	void * timeout_func = htcd->id == TCD_1? TCD_timeout_tcd_1 : TCD_timeout_tcd_2;
-	htcd->timeout_task_id = SCH_Add_Task(timeout_func, PAYOUT_DURATION, 0);
+	TCD_start_timeout(htcd, PAYOUT_DURATION);
 	htcd->state = TCD_WAIT_FOR_PAYOUTING;
 }
 
 static void TCD_wait_for_payouting(TCD_HandleType_t *htcd){
 	if(htcd->timeout){
 		TCD_payout_card(htcd->id, false);
-		SCH_Delete_Task(htcd->timeout_task_id);
-		htcd->timeout = false;
-		void * timeout_func = htcd->id == TCD_1? TCD_timeout_tcd_1 : TCD_timeout_tcd_2;
-		htcd->timeout_task_id = SCH_Add_Task(timeout_func, CARD_TO_PLACE_CARD_TIMEOUT, 0);
+		TCD_start_timeout(htcd, CARD_TO_PLACE_CARD_TIMEOUT);
 		htcd->state = TCD_WAIT_FOR_CARD_IN_PLACE;
 	}
 }
@@ -333,17 +330,11 @@ static void TCD_wait_for_card_in_place(TCD_HandleType_t *htcd){
 	if(htcd->timeout){
 		utils_log_error("Timeout to payout card, should callback card\r\n");
 		if(callback_card_cb) callback_card_cb(htcd->id);
-		SCH_Delete_Task(htcd->timeout_task_id);
-		htcd->timeout = false;
-		void * timeout_func = htcd->id == TCD_1? TCD_timeout_tcd_1 : TCD_timeout_tcd_2;
-		htcd->timeout_task_id = SCH_Add_Task(timeout_func, ERROR_CHECK_INTERVAL, 0);
+		TCD_start_timeout(htcd, ERROR_CHECK_INTERVAL);
 		htcd->state = TCD_ERROR;
 	}
 	if(TCD_is_out_ok(htcd->id)){
-		SCH_Delete_Task(htcd->timeout_task_id);
-		htcd->timeout = false;
-		void * timeout_func = htcd->id == TCD_1? TCD_timeout_tcd_1 : TCD_timeout_tcd_2;
-		htcd->timeout_task_id = SCH_Add_Task(timeout_func, TAKING_CARD_TIMEOUT, 0);
+		TCD_start_timeout(htcd, TAKING_CARD_TIMEOUT);
 		htcd->state = TCD_WAIT_FOR_TAKING_CARD;
 	}
 }
@@ -358,15 +349,12 @@ static void TCD_wait_for_taking_card(TCD_HandleType_t *htcd){
 	if(!TCD_is_out_ok(htcd->id)){
 		// Should callback
 		if(take_card_cb) take_card_cb(htcd->id);
-		SCH_Delete_Task(htcd->timeout_task_id);
-		htcd->timeout = false;
 		if(TCD_is_lower(htcd->id)){
 			updating_status_time = UPDATING_STATUS_TIME_WHEN_LOWER;
 		}else{
 			updating_status_time = UPDATING_STATUS_TIME_WHEN_NORMAL;
 		}
-		void * timeout_func = htcd->id == TCD_1? TCD_timeout_tcd_1 : TCD_timeout_tcd_2;
-		htcd->timeout_task_id = SCH_Add_Task(timeout_func, updating_status_time , 0);
+		TCD_start_timeout(htcd, updating_status_time);
 		htcd->state = TCD_WAIT_FOR_UPDATING_STATUS;
 	}
 }
@@ -376,10 +364,7 @@ static void TCD_callbacking(TCD_HandleType_t *htcd){
 	// Should callback
 	if(callback_card_cb) callback_card_cb(htcd->id);
 	// How long to enable payout signal
-	SCH_Delete_Task(htcd->timeout_task_id);
-	htcd->timeout = false;
-	void * timeout_func = htcd->id == TCD_1? TCD_timeout_tcd_1 : TCD_timeout_tcd_2;
-	htcd->timeout_task_id = SCH_Add_Task(timeout_func, CALLBACK_DURATION, 0);
+	TCD_start_timeout(htcd, CALLBACK_DURATION);
 	htcd->state = TCD_WAIT_FOR_CALLBACKING;
 }
 
@@ -402,26 +387,51 @@ static void TCD_error(TCD_HandleType_t *htcd){
 		if(!TCD_is_error(htcd->id)){
 			htcd->state = TCD_IDLE;
 		}else{
-			SCH_Delete_Task(htcd->timeout_task_id);
-			htcd->timeout = false;
-			void * timeout_func = htcd->id == TCD_1? TCD_timeout_tcd_1 : TCD_timeout_tcd_2;
-			htcd->timeout_task_id = SCH_Add_Task(timeout_func, ERROR_CHECK_INTERVAL, 0);
+			TCD_start_timeout(htcd, ERROR_CHECK_INTERVAL);
 		}
 	}
 }
 
+static bool TCD_needs_run(TCD_HandleType_t *htcd){
+	return htcd->state == TCD_WAIT_FOR_CARD_IN_PLACE
+			|| htcd->state == TCD_WAIT_FOR_TAKING_CARD
+			|| htcd->state == TCD_RESETING
+			|| htcd->state == TCD_PAYOUTING
+			|| htcd->state == TCD_CALLBACKING;
+}
+
 static void TCD_update_status(TCD_HandleType_t *htcd){
+	TCD_status_t prev_status = htcd->status;
 	// Get status of 2 TCD
 	htcd->status.is_empty = TCD_is_empty(htcd->id);
 	htcd->status.is_error = TCD_is_error(htcd->id);
 	htcd->status.is_lower = TCD_is_lower(htcd->id);
+	if(htcd->status.is_empty != prev_status.is_empty
+			|| htcd->status.is_error != prev_status.is_error
+			|| htcd->status.is_lower != prev_status.is_lower){
+		EVENTBUS_post(EVENT_STATUS_CHANGED);
+	}
 }
 
 static void TCD_timeout_tcd_1(){
 	htcd_1.timeout = true;
+	EVENTBUS_post(EVENT_TCD);
 }
 static void TCD_timeout_tcd_2(){
 	htcd_2.timeout = true;
+	EVENTBUS_post(EVENT_TCD);
+}
+static void TCD_timeout_for_status(){
+	EVENTBUS_post(EVENT_TCD);
+}
+
+static void TCD_start_timeout(TCD_HandleType_t *htcd, uint32_t duration){
+	htcd->timeout = false;
+	// Move the pending timeout, add a new one if it already fired
+	if(!SCH_Reschedule(htcd->timeout_task_id, duration)){
+		void * timeout_func = htcd->id == TCD_1? TCD_timeout_tcd_1 : TCD_timeout_tcd_2;
+		htcd->timeout_task_id = SCH_Add_Task_Priority(timeout_func, duration, 0, SCH_PRIORITY_CRITICAL);
+	}
 }
 
 
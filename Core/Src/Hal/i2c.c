@@ -7,14 +7,72 @@
 
 
 #include "main.h"
+#include "string.h"
 #include "Hal/i2c.h"
 
+#define I2C_CLOCK_STANDARD		100000
+#define I2C_CLOCK_FAST			400000
+#define I2C_SCL_PIN				GPIO_PIN_6
+#define I2C_SDA_PIN				GPIO_PIN_7
+#define I2C_RECOVER_DELAY_US	5		// Half period of the recovery clock, 100 kHz
+
+enum {
+	I2C_WRITE_OP,
+	I2C_READ_OP,
+	I2C_MEM_WRITE_OP,
+	I2C_MEM_READ_OP
+};
+
+typedef struct {
+	uint8_t op;
+	uint8_t address;
+	uint16_t mem_address;
+	uint16_t mem_size;
+	uint8_t * data;				// buf for a write, the caller buffer for a read
+	uint16_t len;
+	uint8_t buf[I2C_WRITE_MAX_LEN];
+	bool started;
+	uint32_t start;				// DWT cycle count at the first attempt
+	uint16_t ack_polls;			// Attempts the device NACKed
+	I2C_cb cb;
+	void * arg;
+}I2C_transaction_t;
+
+typedef struct {
+	uint8_t address;
+	uint8_t flags;
+}I2C_device_t;
 
 I2C_HandleTypeDef hi2c1;
 
+// Transactions in order, the head one owns the bus while running is set
+static I2C_transaction_t queue[I2C_QUEUE_SIZE];
+static uint8_t queue_head = 0;
+static volatile uint8_t queue_len = 0;
+static volatile bool running = false;
+static I2C_device_t device_table[I2C_DEVICE_MAX];
+static uint8_t device_len = 0;
+static uint32_t error_count = 0;
+static uint32_t recover_count = 0;
+
+static bool I2C_submit(uint8_t op, uint8_t address, uint16_t mem_address, uint16_t mem_size, uint8_t * data, size_t len, I2C_cb cb, void * arg);
+static bool I2C_transact(uint8_t op, uint8_t address, uint16_t mem_address, uint16_t mem_size, uint8_t * data, size_t len);
+static void I2C_transact_cb(bool success, void * arg);
+static void I2C_start();
+static HAL_StatusTypeDef I2C_transfer(I2C_transaction_t * transaction);
+static void I2C_done(bool success);
+static uint8_t I2C_get_device_flags(uint8_t address);
+static void I2C_set_speed(uint32_t speed);
+static void I2C_recover();
+static void I2C_recover_delay();
+static bool I2C_is_timeout(uint32_t start);
+
 void I2C_init(){
+	// Cycle counter for the timeouts, SysTick may be masked while the queue is served
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
 	hi2c1.Instance = I2C1;
-	hi2c1.Init.ClockSpeed = 100000;
+	hi2c1.Init.ClockSpeed = I2C_CLOCK_STANDARD;
 	hi2c1.Init.DutyCycle = I2C_DUTYCYCLE_2;
 	hi2c1.Init.OwnAddress1 = 0;
 	hi2c1.Init.AddressingMode = I2C_ADDRESSINGMODE_7BIT;
@@ -26,18 +84,37 @@ void I2C_init(){
 	{
 	Error_Handler();
 	}
+	// A device reset in the middle of a transfer may still hold SDA low
+	if(__HAL_I2C_GET_FLAG(&hi2c1, I2C_FLAG_BUSY)){
+		I2C_recover();
+	}
+}
+
+/**
+ * Speed and ACK polling of a device, applied to all its transactions
+ */
+bool I2C_set_device_flags(uint8_t address, uint8_t flags){
+	for (int var = 0; var < device_len; ++var) {
+		if(device_table[var].address == address){
+			device_table[var].flags = flags;
+			return true;
+		}
+	}
+	if(device_len >= I2C_DEVICE_MAX){
+		return false;
+	}
+	device_table[device_len].address = address;
+	device_table[device_len].flags = flags;
+	device_len++;
+	return true;
 }
 
 bool I2C_write(uint8_t address, uint8_t * data_w, size_t w_len){
-	// Write
-	bool success = HAL_I2C_Master_Transmit(&hi2c1, address, data_w, w_len, I2C_TIMEOUT) == HAL_OK;
-	return success;
+	return I2C_transact(I2C_WRITE_OP, address, 0, 0, data_w, w_len);
 }
 
 bool I2C_read(uint8_t address, uint8_t * data_r, size_t r_len){
-	// Read
-	bool success = HAL_I2C_Master_Receive(&hi2c1, address, data_r, r_len, I2C_TIMEOUT) == HAL_OK;
-	return success;
+	return I2C_transact(I2C_READ_OP, address, 0, 0, data_r, r_len);
 }
 
 bool I2C_write_and_read(uint8_t address, uint8_t * data_w, size_t w_len, uint8_t * data_r, size_t r_len){
@@ -50,16 +127,261 @@ bool I2C_write_and_read(uint8_t address, uint8_t * data_w, size_t w_len, uint8_t
 
 
 bool I2C_mem_write(uint8_t address, uint16_t mem_address, uint16_t mem_size, uint8_t * data_w, size_t w_len){
-	// Write
-	bool success = HAL_I2C_Mem_Write(&hi2c1, address, mem_address, mem_size, data_w, w_len, I2C_TIMEOUT);
-	return success;
+	return I2C_transact(I2C_MEM_WRITE_OP, address, mem_address, mem_size, data_w, w_len);
 }
 
-bool I2C_mem_read(uint8_t address, uint16_t mem_address, uint16_t mem_size, uint8_t * data_w, size_t w_len){
-	// Write
-	bool success = HAL_I2C_Mem_Read(&hi2c1, address, mem_address, mem_size, data_w, w_len, I2C_TIMEOUT);
-	return success;
+bool I2C_mem_read(uint8_t address, uint16_t mem_address, uint16_t mem_size, uint8_t * data_r, size_t r_len){
+	return I2C_transact(I2C_MEM_READ_OP, address, mem_address, mem_size, data_r, r_len);
+}
+
+bool I2C_mem_write_async(uint8_t address, uint16_t mem_address, uint16_t mem_size, uint8_t * data_w, size_t w_len, I2C_cb cb, void * arg){
+	return I2C_submit(I2C_MEM_WRITE_OP, address, mem_address, mem_size, data_w, w_len, cb, arg);
+}
+
+bool I2C_mem_read_async(uint8_t address, uint16_t mem_address, uint16_t mem_size, uint8_t * data_r, size_t r_len, I2C_cb cb, void * arg){
+	return I2C_submit(I2C_MEM_READ_OP, address, mem_address, mem_size, data_r, r_len, cb, arg);
+}
+
+bool I2C_is_idle(){
+	return queue_len == 0;
+}
+
+/**
+ * Give up on a transaction stuck for longer than I2C_TIMEOUT, called by the
+ * drivers from the main loop
+ */
+void I2C_poll(){
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if(running && I2C_is_timeout(queue[queue_head].start)){
+		I2C_recover();
+		I2C_done(false);
+	}else if(!running && queue_len){
+		I2C_start();
+	}
+	__set_PRIMASK(primask);
+}
+
+/**
+ * Block until every queued transaction is done
+ */
+void I2C_wait(){
+	while(!I2C_is_idle()){
+		I2C_poll();
+	}
+}
+
+uint32_t I2C_get_error_count(){
+	return error_count;
+}
+
+uint32_t I2C_get_recover_count(){
+	return recover_count;
+}
+
+void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c){
+	I2C_done(true);
+}
+
+void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c){
+	I2C_done(true);
+}
+
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c){
+	I2C_done(true);
 }
 
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c){
+	I2C_done(true);
+}
+
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c){
+	I2C_transaction_t * transaction = &queue[queue_head];
+	uint32_t error = hi2c->ErrorCode;
+	if(!running){
+		return;
+	}
+	if(error == HAL_I2C_ERROR_AF && (I2C_get_device_flags(transaction->address) & I2C_ACK_POLL)
+			&& ++transaction->ack_polls < I2C_ACK_POLL_MAX){
+		// Busy with its write cycle, address it again until it answers
+		running = false;
+		I2C_start();
+		return;
+	}
+	if(error & (HAL_I2C_ERROR_BERR | HAL_I2C_ERROR_ARLO | HAL_I2C_ERROR_TIMEOUT)){
+		I2C_recover();
+	}
+	I2C_done(false);
+}
+
+static bool I2C_submit(uint8_t op, uint8_t address, uint16_t mem_address, uint16_t mem_size, uint8_t * data, size_t len, I2C_cb cb, void * arg){
+	I2C_transaction_t * transaction;
+	uint32_t primask;
+	bool write = (op == I2C_WRITE_OP || op == I2C_MEM_WRITE_OP);
+	if(len == 0 || (write && len > I2C_WRITE_MAX_LEN)){
+		return false;
+	}
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if(queue_len >= I2C_QUEUE_SIZE){
+		__set_PRIMASK(primask);
+		return false;
+	}
+	transaction = &queue[(queue_head + queue_len) % I2C_QUEUE_SIZE];
+	transaction->op = op;
+	transaction->address = address;
+	transaction->mem_address = mem_address;
+	transaction->mem_size = mem_size;
+	transaction->len = len;
+	transaction->started = false;
+	transaction->cb = cb;
+	transaction->arg = arg;
+	if(write){
+		memcpy(transaction->buf, data, len);
+		transaction->data = transaction->buf;
+	}else{
+		transaction->data = data;
+	}
+	queue_len++;
+	I2C_start();
+	__set_PRIMASK(primask);
+	return true;
+}
 
+/**
+ * Queue the transaction behind the others and wait for its end
+ */
+static bool I2C_transact(uint8_t op, uint8_t address, uint16_t mem_address, uint16_t mem_size, uint8_t * data, size_t len){
+	volatile uint8_t result = 0;
+	if(len == 0 || ((op == I2C_WRITE_OP || op == I2C_MEM_WRITE_OP) && len > I2C_WRITE_MAX_LEN)){
+		return false;
+	}
+	while(!I2C_submit(op, address, mem_address, mem_size, data, len, I2C_transact_cb, (void *)&result)){
+		I2C_poll();
+	}
+	while(result == 0){
+		I2C_poll();
+	}
+	return result == 1;
+}
+
+static void I2C_transact_cb(bool success, void * arg){
+	*(volatile uint8_t *)arg = success ? 1 : 2;
+}
+
+/**
+ * Start the head transaction if the bus is free, called with the I2C interrupts masked
+ */
+static void I2C_start(){
+	I2C_transaction_t * transaction;
+	while(!running && queue_len){
+		transaction = &queue[queue_head];
+		if(!transaction->started){
+			transaction->started = true;
+			transaction->start = DWT->CYCCNT;
+			transaction->ack_polls = 0;
+		}
+		I2C_set_speed(I2C_get_device_flags(transaction->address) & I2C_FAST ? I2C_CLOCK_FAST : I2C_CLOCK_STANDARD);
+		running = true;
+		if(I2C_transfer(transaction) == HAL_OK){
+			return;
+		}
+		// The bus stays busy, free it and try once more
+		I2C_recover();
+		if(I2C_transfer(transaction) == HAL_OK){
+			return;
+		}
+		I2C_done(false);
+	}
+}
 
+static HAL_StatusTypeDef I2C_transfer(I2C_transaction_t * transaction){
+	switch (transaction->op) {
+		case I2C_WRITE_OP:
+			return HAL_I2C_Master_Transmit_IT(&hi2c1, transaction->address, transaction->data, transaction->len);
+		case I2C_READ_OP:
+			return HAL_I2C_Master_Receive_IT(&hi2c1, transaction->address, transaction->data, transaction->len);
+		case I2C_MEM_WRITE_OP:
+			return HAL_I2C_Mem_Write_IT(&hi2c1, transaction->address, transaction->mem_address, transaction->mem_size, transaction->data, transaction->len);
+		case I2C_MEM_READ_OP:
+			return HAL_I2C_Mem_Read_IT(&hi2c1, transaction->address, transaction->mem_address, transaction->mem_size, transaction->data, transaction->len);
+		default:
+			return HAL_ERROR;
+	}
+}
+
+/**
+ * End the head transaction, call its callback then start the next one
+ */
+static void I2C_done(bool success){
+	I2C_transaction_t * transaction = &queue[queue_head];
+	I2C_cb cb = transaction->cb;
+	void * arg = transaction->arg;
+	if(!success){
+		error_count++;
+	}
+	queue_head = (queue_head + 1) % I2C_QUEUE_SIZE;
+	queue_len--;
+	running = false;
+	// The callback may queue the next transaction itself
+	if(cb){
+		cb(success, arg);
+	}
+	I2C_start();
+}
+
+static uint8_t I2C_get_device_flags(uint8_t address){
+	for (int var = 0; var < device_len; ++var) {
+		if(device_table[var].address == address){
+			return device_table[var].flags;
+		}
+	}
+	return 0;
+}
+
+static void I2C_set_speed(uint32_t speed){
+	if(hi2c1.Init.ClockSpeed == speed){
+		return;
+	}
+	hi2c1.Init.ClockSpeed = speed;
+	HAL_I2C_Init(&hi2c1);
+}
+
+/**
+ * Clock out a device holding SDA low, send a STOP and start the peripheral again
+ */
+static void I2C_recover(){
+	GPIO_InitTypeDef GPIO_InitStruct = {0};
+	recover_count++;
+	HAL_I2C_DeInit(&hi2c1);
+	GPIO_InitStruct.Pin = I2C_SCL_PIN | I2C_SDA_PIN;
+	GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_OD;
+	GPIO_InitStruct.Pull = GPIO_NOPULL;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+	HAL_GPIO_WritePin(GPIOB, I2C_SCL_PIN | I2C_SDA_PIN, GPIO_PIN_SET);
+	HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+	for (int var = 0; var < 9 && HAL_GPIO_ReadPin(GPIOB, I2C_SDA_PIN) == GPIO_PIN_RESET; ++var) {
+		HAL_GPIO_WritePin(GPIOB, I2C_SCL_PIN, GPIO_PIN_RESET);
+		I2C_recover_delay();
+		HAL_GPIO_WritePin(GPIOB, I2C_SCL_PIN, GPIO_PIN_SET);
+		I2C_recover_delay();
+	}
+	// STOP: SDA rises while SCL is high
+	HAL_GPIO_WritePin(GPIOB, I2C_SCL_PIN, GPIO_PIN_RESET);
+	HAL_GPIO_WritePin(GPIOB, I2C_SDA_PIN, GPIO_PIN_RESET);
+	I2C_recover_delay();
+	HAL_GPIO_WritePin(GPIOB, I2C_SCL_PIN, GPIO_PIN_SET);
+	I2C_recover_delay();
+	HAL_GPIO_WritePin(GPIOB, I2C_SDA_PIN, GPIO_PIN_SET);
+	I2C_recover_delay();
+	// Back to the peripheral, the MSP init restores the pins
+	HAL_I2C_Init(&hi2c1);
+}
+
+static void I2C_recover_delay(){
+	for (volatile uint32_t var = 0; var < SystemCoreClock / 1000000 * I2C_RECOVER_DELAY_US / 4; ++var);
+}
+
+static bool I2C_is_timeout(uint32_t start){
+	return DWT->CYCCNT - start > SystemCoreClock / 1000 * I2C_TIMEOUT;
+}
@@ -0,0 +1,57 @@
+/*
+ * power.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: agent
+ */
+
+
+#include "main.h"
+#include "Hal/power.h"
+
+#define POWER_FN_MAX_SIZE	2
+
+static POWER_fn fn_table[POWER_FN_MAX_SIZE];
+static size_t fn_table_len = 0;
+static uint32_t fail_count = 0;
+
+/**
+ * Watch the supply with the PVD, the attached functions run from its interrupt
+ * when VDD falls below POWER_PVD_LEVEL
+ */
+bool POWER_init(){
+	PWR_PVDTypeDef pvd = {
+		.PVDLevel = POWER_PVD_LEVEL,
+		// PVDO rises when VDD falls below the threshold
+		.Mode = PWR_PVD_MODE_IT_RISING
+	};
+	__HAL_RCC_PWR_CLK_ENABLE();
+	HAL_PWR_ConfigPVD(&pvd);
+	HAL_PWR_EnablePVD();
+	HAL_NVIC_SetPriority(PVD_IRQn, POWER_PVD_PRIORITY, 0);
+	HAL_NVIC_EnableIRQ(PVD_IRQn);
+	return true;
+}
+
+bool POWER_attach_fail(POWER_fn fn){
+	if(fn_table_len >= POWER_FN_MAX_SIZE){
+		return false;
+	}
+	fn_table[fn_table_len++] = fn;
+	return true;
+}
+
+bool POWER_is_low(){
+	return __HAL_PWR_GET_FLAG(PWR_FLAG_PVDO);
+}
+
+uint32_t POWER_get_fail_count(){
+	return fail_count;
+}
+
+void HAL_PWR_PVDCallback(){
+	fail_count++;
+	for (int fn_idx = 0; fn_idx < fn_table_len; ++fn_idx) {
+		fn_table[fn_idx]();
+	}
+}
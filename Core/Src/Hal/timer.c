@@ -13,6 +13,7 @@
 #include "utils/utils_logger.h"
 
 #define TIMER_FN_MAX_SIZE	10
+#define TIMER_MAX_SUPPRESS_TICKS	(0xFFFF / TIMER_COUNTS_PER_TICK)
 
 static TIMER_fn fn_table[TIMER_FN_MAX_SIZE];
 static size_t fn_table_len = 0;
@@ -22,7 +23,7 @@ TIM_HandleTypeDef htim3 = {
 	.Init = {
 		.Prescaler = 71,
 		.CounterMode = TIM_COUNTERMODE_UP,
-		.Period = 999,
+		.Period = TIMER_COUNTS_PER_TICK - 1,
 		.ClockDivision = TIM_CLOCKDIVISION_DIV1,
 		.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE
 	}
@@ -63,6 +64,52 @@ bool TIMER_attach_intr_1ms(void (*fn)(void)){
 	return true;
 }
 
+/**
+ * Stretch the next TIM3 update to fire after `ticks` 1ms periods instead of one.
+ * Must be called with interrupts disabled, returns the number of ticks programmed.
+ * Returns 0 and leaves the period as it is when a 1ms update is already pending:
+ * it would wake the sleep at once and be counted as the long period
+ */
+uint32_t TIMER_suppress_intr_1ms(uint32_t ticks){
+	if(ticks > TIMER_MAX_SUPPRESS_TICKS){
+		ticks = TIMER_MAX_SUPPRESS_TICKS;
+	}
+	if(ticks <= 1){
+		return 1;
+	}
+	if(__HAL_TIM_GET_FLAG(&htim3, TIM_FLAG_UPDATE)){
+		return 0;
+	}
+	__HAL_TIM_SET_AUTORELOAD(&htim3, ticks * TIMER_COUNTS_PER_TICK - 1);
+	// The update may have come between the check and the write
+	if(__HAL_TIM_GET_FLAG(&htim3, TIM_FLAG_UPDATE)){
+		__HAL_TIM_SET_AUTORELOAD(&htim3, TIMER_COUNTS_PER_TICK - 1);
+		return 0;
+	}
+	return ticks;
+}
+
+/**
+ * Go back to the 1ms period after TIMER_suppress_intr_1ms. The pending update
+ * of the long period is consumed here, the partial tick is kept in the counter.
+ * Returns the counts elapsed since the last tick boundary.
+ */
+uint32_t TIMER_resume_intr_1ms(){
+	uint32_t counts = __HAL_TIM_GET_COUNTER(&htim3);
+	if(__HAL_TIM_GET_FLAG(&htim3, TIM_FLAG_UPDATE)){
+		counts = __HAL_TIM_GET_COUNTER(&htim3) + __HAL_TIM_GET_AUTORELOAD(&htim3) + 1;
+		__HAL_TIM_CLEAR_FLAG(&htim3, TIM_FLAG_UPDATE);
+		HAL_NVIC_ClearPendingIRQ(TIM3_IRQn);
+	}
+	__HAL_TIM_SET_AUTORELOAD(&htim3, TIMER_COUNTS_PER_TICK - 1);
+	__HAL_TIM_SET_COUNTER(&htim3, counts % TIMER_COUNTS_PER_TICK);
+	return counts;
+}
+
+uint32_t TIMER_get_counts(){
+	return __HAL_TIM_GET_COUNTER(&htim3);
+}
+
 void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef * htim){
 	if(htim->Instance == htim3.Instance){
 		for (int fn_idx = 0; fn_idx < fn_table_len; ++fn_idx) {
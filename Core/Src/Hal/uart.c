@@ -7,16 +7,69 @@
 
 
 #include "main.h"
+#include "string.h"
 #include "Hal/uart.h"
-#include "utils/utils_buffer.h"
+#include "ringbuffer/ringbuffer.h"
 #include "utils/utils_logger.h"
 
 #define TX_TIMEOUT		0xFFFF
+#define UART_DMA_RX_SIZE	64		// Words in the circular DMA buffer
+#define UART_FRAME_END_BIT	0x100	// MDB mode bit, set on the last word of a frame
+#define UART_IT_RX_SIZE		256		// Bytes buffered by the interrupt per byte reception
+
+#if (UART_DMA_RING_SIZE & (UART_DMA_RING_SIZE - 1)) != 0
+#error "UART_DMA_RING_SIZE must be a power of two"
+#endif
+
+typedef struct {
+	uint16_t data[UART_FRAME_MAX_LEN];
+	size_t len;
+}UART_frame_t;
+
+// Circular DMA reception cut into frames from the DMA half/full/idle-line interrupts
+typedef struct {
+	uint16_t dma_buf[UART_DMA_RX_SIZE];
+	uint16_t dma_pos;			// Next word to take in dma_buf
+	UART_frame_t frame;			// Frame being received
+	UART_frame_t queue[UART_FRAME_QUEUE_SIZE];
+	uint8_t queue_head;
+	volatile uint8_t queue_len;
+	uint32_t drop_count;		// Frames lost because the queue was full or too long
+}UART_frame_rx_t;
+
+// Circular DMA reception read in place, the DMA half/full/idle-line interrupts commit the new bytes to the ring
+typedef struct {
+	uint8_t buf[UART_DMA_RING_SIZE];
+	uint16_t dma_pos;			// DMA position at the last interrupt
+	// The DMA restarts after an error at the start of the buffer, the head jumps from
+	// pad_start to restart over bytes never received. The reader skips them
+	volatile uint32_t pad_start;
+	volatile uint32_t restart;
+}UART_ring_rx_t;
+
+// Transmit queue, the DMA sends the words between tail and head, one contiguous run at a time
+typedef struct {
+	uint8_t * buf;
+	uint16_t size;				// Words in buf
+	uint8_t word_size;			// Bytes per word, 2 for 9-bit
+	uint32_t head;				// Words queued since start
+	uint32_t tail;				// Words sent since start
+	uint16_t dma_len;			// Words in the running DMA transfer, 0 when idle
+	uint32_t drop_count;		// Sends refused because the queue was full
+}UART_tx_t;
 
 typedef struct {
 	UART_HandleTypeDef * huart_p;
-	utils_buffer_t * buffer;
+	RINGBUFFER_t rx;			// Received bytes, filled by the DMA (ring mode) or the byte interrupt
+	uint8_t * rx_buf;
+	uint16_t rx_size;
 	uint16_t temp_data;
+	UART_rx_cb rx_cb;
+	UART_tx_cb tx_cb;
+	UART_tx_t * tx;				// NULL: UART_send blocks until sent
+	UART_frame_rx_t * frame_rx;	// Frame mode
+	UART_ring_rx_t * ring_rx;	// Ring mode, both NULL: one interrupt per byte into rx
+	uint32_t overrun_count;		// Hardware overruns
 }UART_info_t;
 
 
@@ -64,27 +117,76 @@ UART_HandleTypeDef huart4 = {
 	.Init.OverSampling = UART_OVERSAMPLING_16
 };
 
-static utils_buffer_t uart_buffer[UART_MAX];
+DMA_HandleTypeDef hdma_usart1_rx;
+DMA_HandleTypeDef hdma_usart2_rx;
+DMA_HandleTypeDef hdma_uart4_rx;
+DMA_HandleTypeDef hdma_usart1_tx;
+DMA_HandleTypeDef hdma_usart2_tx;
+DMA_HandleTypeDef hdma_uart4_tx;
+
+static UART_frame_rx_t uart2_frame_rx;
+#if UART1_RX_DMA
+static UART_ring_rx_t uart1_ring_rx;
+#else
+static uint8_t uart1_rx_buf[UART_IT_RX_SIZE];
+#endif
+static uint8_t uart3_rx_buf[UART_IT_RX_SIZE];
+#if UART4_RX_DMA
+static UART_ring_rx_t uart4_ring_rx;
+#else
+static uint8_t uart4_rx_buf[UART_IT_RX_SIZE];
+#endif
+static uint8_t uart1_tx_buf[UART_TX_QUEUE_SIZE];
+static uint16_t uart2_tx_buf[UART_MDB_TX_QUEUE_SIZE];
+static uint8_t uart4_tx_buf[UART_TX_QUEUE_SIZE];
+static UART_tx_t uart1_tx = {.buf = uart1_tx_buf, .size = UART_TX_QUEUE_SIZE, .word_size = sizeof(uint8_t)};
+static UART_tx_t uart2_tx = {.buf = (uint8_t *)uart2_tx_buf, .size = UART_MDB_TX_QUEUE_SIZE, .word_size = sizeof(uint16_t)};
+static UART_tx_t uart4_tx = {.buf = uart4_tx_buf, .size = UART_TX_QUEUE_SIZE, .word_size = sizeof(uint8_t)};
 
 static UART_info_t uart_table[UART_MAX] = {
 		[UART_1] = {
 			.huart_p = &huart1,
-			.buffer = &uart_buffer[UART_1]
+			.tx = &uart1_tx,
+#if UART1_RX_DMA
+			.ring_rx = &uart1_ring_rx,
+			.rx_buf = uart1_ring_rx.buf,
+			.rx_size = UART_DMA_RING_SIZE
+#else
+			.rx_buf = uart1_rx_buf,
+			.rx_size = UART_IT_RX_SIZE
+#endif
 		},
 		[UART_2] = {
 			.huart_p = &huart2,
-			.buffer = &uart_buffer[UART_2]
+			.frame_rx = &uart2_frame_rx,
+			.tx = &uart2_tx
 		},
 		[UART_3] = {
 			.huart_p = &huart3,
-			.buffer = &uart_buffer[UART_3]
+			.rx_buf = uart3_rx_buf,
+			.rx_size = UART_IT_RX_SIZE
 		},
 		[UART_4] = {
 			.huart_p = &huart4,
-			.buffer = &uart_buffer[UART_4]
+			.tx = &uart4_tx,
+#if UART4_RX_DMA
+			.ring_rx = &uart4_ring_rx,
+			.rx_buf = uart4_ring_rx.buf,
+			.rx_size = UART_DMA_RING_SIZE
+#else
+			.rx_buf = uart4_rx_buf,
+			.rx_size = UART_IT_RX_SIZE
+#endif
 		},
 };
 
+static void UART_start_rx(UART_id_t id);
+static RINGBUFFER_t * UART_get_rx(UART_id_t id, size_t * len);
+static void UART_start_frame_rx(UART_id_t id);
+static void UART_ring_rx_event(UART_info_t * info, uint16_t pos);
+static void UART_frame_rx_event(UART_info_t * info, uint16_t pos);
+static void UART_frame_rx_push(UART_info_t * info, uint16_t data);
+static void UART_tx_start(UART_info_t * info);
 
 bool UART_init(){
 	bool success = true;
@@ -94,32 +196,186 @@ bool UART_init(){
 //	success = (HAL_UART_Init(uart_table[UART_3].huart_p) == HAL_OK) && success;
 	success = (HAL_UART_Init(uart_table[UART_4].huart_p) == HAL_OK) && success;
 	// Init buffer
-	success = utils_buffer_init(uart_table[UART_1].buffer, sizeof(uint8_t)) && success;
-	success = utils_buffer_init(uart_table[UART_2].buffer, sizeof(uint16_t)) && success;
-//	success = utils_buffer_init(uart_table[UART_3].buffer, sizeof(uint8_t)) && success;
-	success = utils_buffer_init(uart_table[UART_4].buffer, sizeof(uint8_t)) && success;
-
-	HAL_UART_Receive_IT(uart_table[UART_1].huart_p, &uart_table[UART_1].temp_data, 1);
-	HAL_UART_Receive_IT(uart_table[UART_2].huart_p, &uart_table[UART_2].temp_data, 1);
-//	HAL_UART_Receive_IT(uart_table[UART_3].huart_p, &uart_table[UART_3].temp_data, 1);
-	HAL_UART_Receive_IT(uart_table[UART_4].huart_p, &uart_table[UART_4].temp_data, 1);
+	success = RINGBUFFER_init(&uart_table[UART_1].rx, uart_table[UART_1].rx_buf, uart_table[UART_1].rx_size) && success;
+//	success = RINGBUFFER_init(&uart_table[UART_3].rx, uart_table[UART_3].rx_buf, uart_table[UART_3].rx_size) && success;
+	success = RINGBUFFER_init(&uart_table[UART_4].rx, uart_table[UART_4].rx_buf, uart_table[UART_4].rx_size) && success;
+	// The DMA commits at half and full buffer, in between it writes up to half a ring ahead
+	for (int id = 0; id < UART_MAX; ++id) {
+		if(uart_table[id].ring_rx){
+			RINGBUFFER_set_write_ahead(&uart_table[id].rx, UART_DMA_RING_SIZE / 2);
+		}
+	}
+
+	UART_start_rx(UART_1);
+	UART_start_rx(UART_2);
+//	UART_start_rx(UART_3);
+	UART_start_rx(UART_4);
 	return success;
 }
+/**
+ * Queue len words for the DMA and return, false when the queue has no room for all of them
+ */
 bool UART_send(UART_id_t id, uint8_t *data , size_t len){
-	HAL_UART_Transmit(uart_table[id].huart_p, data, len, 0xFFFF);
+	UART_tx_t * tx = uart_table[id].tx;
+	uint32_t primask;
+	size_t offset;
+	size_t first;
+	if(tx == NULL){
+		return HAL_UART_Transmit(uart_table[id].huart_p, data, len, TX_TIMEOUT) == HAL_OK;
+	}
+	// Interrupts off for the whole copy, so an RX callback may send too
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if(len > tx->size - (tx->head - tx->tail)){
+		tx->drop_count++;
+		__set_PRIMASK(primask);
+		return false;
+	}
+	offset = tx->head % tx->size;
+	first = tx->size - offset;
+	if(first > len){
+		first = len;
+	}
+	memcpy(tx->buf + offset * tx->word_size, data, first * tx->word_size);
+	memcpy(tx->buf, data + first * tx->word_size, (len - first) * tx->word_size);
+	tx->head += len;
+	if(tx->dma_len == 0){
+		UART_tx_start(&uart_table[id]);
+	}
+	__set_PRIMASK(primask);
+	return true;
 }
+/**
+ * Bytes waiting for UART_receive_data, always false in frame mode
+ */
 bool UART_receive_available(UART_id_t id){
-	return utils_buffer_is_available(uart_table[id].buffer);
+	RINGBUFFER_t * rx = UART_get_rx(id, NULL);
+	return rx && RINGBUFFER_available(rx) > 0;
+}
+
+/**
+ * Frames waiting for UART_receive_frame
+ */
+bool UART_receive_frame_available(UART_id_t id){
+	return uart_table[id].frame_rx && uart_table[id].frame_rx->queue_len > 0;
 }
 
 uint16_t UART_receive_data(UART_id_t id){
-	uint16_t data;
-	utils_buffer_pop(uart_table[id].buffer, &data);
+	RINGBUFFER_t * rx = UART_get_rx(id, NULL);
+	uint8_t data = 0;
+	// Frame mode has no bytes, see UART_receive_frame
+	if(rx != NULL){
+		RINGBUFFER_pop(rx, &data);
+	}
 	return data;
 }
 
+/**
+ * Take up to len received bytes in one call, returns the number taken
+ */
+size_t UART_receive(UART_id_t id, uint8_t * data, size_t len){
+	RINGBUFFER_t * rx = UART_get_rx(id, &len);
+	if(rx == NULL){
+		return 0;
+	}
+	return RINGBUFFER_read(rx, data, len);
+}
+
+/**
+ * Copy up to len received bytes but leave them to be read again
+ */
+size_t UART_peek(UART_id_t id, uint8_t * data, size_t len){
+	RINGBUFFER_t * rx = UART_get_rx(id, &len);
+	if(rx == NULL){
+		return 0;
+	}
+	return RINGBUFFER_peek(rx, data, len);
+}
+
 void UART_clear_buffer(UART_id_t id){
-	utils_buffer_drop_all(uart_table[id].buffer);
+	UART_frame_rx_t * frame_rx = uart_table[id].frame_rx;
+	uint32_t primask;
+	if(frame_rx){
+		primask = __get_PRIMASK();
+		__disable_irq();
+		frame_rx->frame.len = 0;
+		frame_rx->queue_len = 0;
+		__set_PRIMASK(primask);
+		return;
+	}
+	RINGBUFFER_clear(&uart_table[id].rx);
+}
+
+/**
+ * Take the oldest complete frame, data must hold UART_FRAME_MAX_LEN words
+ */
+bool UART_receive_frame(UART_id_t id, uint16_t * data, size_t * len){
+	UART_frame_rx_t * frame_rx = uart_table[id].frame_rx;
+	UART_frame_t * frame;
+	uint32_t primask;
+	if(frame_rx == NULL || frame_rx->queue_len == 0){
+		return false;
+	}
+	// The interrupt only writes behind the queue, the head is ours until released
+	frame = &frame_rx->queue[frame_rx->queue_head];
+	memcpy(data, frame->data, frame->len * sizeof(uint16_t));
+	*len = frame->len;
+	primask = __get_PRIMASK();
+	__disable_irq();
+	frame_rx->queue_head = (frame_rx->queue_head + 1) % UART_FRAME_QUEUE_SIZE;
+	frame_rx->queue_len--;
+	__set_PRIMASK(primask);
+	return true;
+}
+
+uint32_t UART_get_overrun_count(UART_id_t id){
+	return uart_table[id].overrun_count + uart_table[id].rx.overwrite_count + uart_table[id].rx.drop_count;
+}
+
+/**
+ * Most bytes ever waiting to be read, to size the receive buffers
+ */
+uint32_t UART_get_rx_high_water(UART_id_t id){
+	return uart_table[id].rx.high_water;
+}
+
+uint32_t UART_get_frame_drop_count(UART_id_t id){
+	if(uart_table[id].frame_rx == NULL){
+		return 0;
+	}
+	return uart_table[id].frame_rx->drop_count;
+}
+
+/**
+ * Callback called from the RX interrupt after a byte (or a frame) is buffered
+ */
+void UART_set_rx_callback(UART_id_t id, UART_rx_cb callback){
+	uart_table[id].rx_cb = callback;
+}
+
+/**
+ * Words UART_send can take right now
+ */
+size_t UART_get_tx_free(UART_id_t id){
+	UART_tx_t * tx = uart_table[id].tx;
+	if(tx == NULL){
+		return SIZE_MAX;
+	}
+	return tx->size - (tx->head - tx->tail);
+}
+
+uint32_t UART_get_tx_drop_count(UART_id_t id){
+	if(uart_table[id].tx == NULL){
+		return 0;
+	}
+	return uart_table[id].tx->drop_count;
+}
+
+/**
+ * Callback called from the TX interrupt when the queue is sent completely
+ */
+void UART_set_tx_callback(UART_id_t id, UART_tx_cb callback){
+	uart_table[id].tx_cb = callback;
 }
 
 void UART_test(){
@@ -130,18 +386,195 @@ void UART_test(){
 	}
 }
 
+/**
+ * Called on DMA half transfer, transfer complete and idle line,
+ * size is the DMA position in the buffer
+ */
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t size){
+	for (int id = 0; id < UART_MAX; ++id) {
+		if(huart->Instance != uart_table[id].huart_p->Instance){
+			continue;
+		}
+		if(uart_table[id].frame_rx){
+			UART_frame_rx_event(&uart_table[id], size);
+		}else if(uart_table[id].ring_rx){
+			UART_ring_rx_event(&uart_table[id], size);
+		}
+	}
+}
+
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart){
+	// Overrun, framing or noise error stopped the reception, start it again
+	for (int id = 0; id < UART_MAX; ++id) {
+		if(huart->Instance != uart_table[id].huart_p->Instance){
+			continue;
+		}
+		if(huart->ErrorCode & HAL_UART_ERROR_ORE){
+			uart_table[id].overrun_count++;
+		}
+		if(huart->ErrorCode & HAL_UART_ERROR_DMA && uart_table[id].tx
+				&& uart_table[id].tx->dma_len && huart->gState == HAL_UART_STATE_READY){
+			// The TX DMA failed, give up on this run and go on with the queue
+			uart_table[id].tx->tail += uart_table[id].tx->dma_len;
+			UART_tx_start(&uart_table[id]);
+		}
+		if(uart_table[id].ring_rx && huart->hdmarx){
+			// Take the bytes the stopped channel wrote since the last event, CNDTR
+			// keeps its value after the abort. Otherwise they fall in the padding
+			UART_ring_rx_event(&uart_table[id], UART_DMA_RING_SIZE - __HAL_DMA_GET_COUNTER(huart->hdmarx));
+		}
+		UART_start_rx(id);
+	}
+}
+
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart){
+	for (int id = 0; id < UART_MAX; ++id) {
+		if(huart->Instance != uart_table[id].huart_p->Instance || uart_table[id].tx == NULL){
+			continue;
+		}
+		uart_table[id].tx->tail += uart_table[id].tx->dma_len;
+		UART_tx_start(&uart_table[id]);
+		if(uart_table[id].tx->dma_len == 0 && uart_table[id].tx_cb){
+			uart_table[id].tx_cb();
+		}
+	}
+}
+
+/**
+ * Start the DMA on the next contiguous run of the queue, called with the TX interrupt masked
+ */
+static void UART_tx_start(UART_info_t * info){
+	UART_tx_t * tx = info->tx;
+	uint32_t count = tx->head - tx->tail;
+	uint16_t offset = tx->tail % tx->size;
+	tx->dma_len = 0;
+	if(count == 0){
+		return;
+	}
+	if(count > tx->size - offset){
+		count = tx->size - offset;
+	}
+	if(HAL_UART_Transmit_DMA(info->huart_p, tx->buf + offset * tx->word_size, count) == HAL_OK){
+		tx->dma_len = count;
+	}
+}
+
+static void UART_start_rx(UART_id_t id){
+	UART_ring_rx_t * ring_rx = uart_table[id].ring_rx;
+	if(uart_table[id].frame_rx){
+		UART_start_frame_rx(id);
+	}else if(ring_rx){
+		// The DMA starts again from the beginning of the buffer, move the
+		// head to the next lap so that positions still match. When the reader
+		// has not reached the padding of an earlier restart yet, the skip runs
+		// from there, the bytes received in between are lost
+		if((int32_t)(ring_rx->restart - uart_table[id].rx.tail) <= 0){
+			ring_rx->pad_start = uart_table[id].rx.head;
+		}
+		RINGBUFFER_commit(&uart_table[id].rx, (UART_DMA_RING_SIZE - uart_table[id].rx.head % UART_DMA_RING_SIZE) % UART_DMA_RING_SIZE);
+		ring_rx->restart = uart_table[id].rx.head;
+		ring_rx->dma_pos = 0;
+		HAL_UARTEx_ReceiveToIdle_DMA(uart_table[id].huart_p, ring_rx->buf, UART_DMA_RING_SIZE);
+	}else{
+		HAL_UART_Receive_IT(uart_table[id].huart_p, &uart_table[id].temp_data, 1);
+	}
+}
+
+static void UART_start_frame_rx(UART_id_t id){
+	UART_frame_rx_t * frame_rx = uart_table[id].frame_rx;
+	frame_rx->dma_pos = 0;
+	frame_rx->frame.len = 0;
+	HAL_UARTEx_ReceiveToIdle_DMA(uart_table[id].huart_p, (uint8_t *)frame_rx->dma_buf, UART_DMA_RX_SIZE);
+}
+
+static void UART_frame_rx_event(UART_info_t * info, uint16_t pos){
+	UART_frame_rx_t * frame_rx = info->frame_rx;
+	uint8_t queue_len = frame_rx->queue_len;
+	while(frame_rx->dma_pos < pos && frame_rx->dma_pos < UART_DMA_RX_SIZE){
+		UART_frame_rx_push(info, frame_rx->dma_buf[frame_rx->dma_pos++]);
+	}
+	if(frame_rx->dma_pos >= UART_DMA_RX_SIZE){
+		// Transfer complete, the DMA wrapped to the start of the buffer
+		frame_rx->dma_pos = 0;
+	}
+	if(frame_rx->queue_len != queue_len && info->rx_cb){
+		info->rx_cb();
+	}
+}
+
+static void UART_ring_rx_event(UART_info_t * info, uint16_t pos){
+	UART_ring_rx_t * ring_rx = info->ring_rx;
+	uint16_t count;
+	if(pos >= ring_rx->dma_pos){
+		count = pos - ring_rx->dma_pos;
+	}else{
+		count = UART_DMA_RING_SIZE - ring_rx->dma_pos + pos;
+	}
+	ring_rx->dma_pos = pos % UART_DMA_RING_SIZE;
+	RINGBUFFER_commit(&info->rx, count);
+	if(count && info->rx_cb){
+		info->rx_cb();
+	}
+}
+
+static void UART_frame_rx_push(UART_info_t * info, uint16_t data){
+	UART_frame_rx_t * frame_rx = info->frame_rx;
+	UART_frame_t * frame = &frame_rx->frame;
+	if(frame->len < UART_FRAME_MAX_LEN){
+		frame->data[frame->len] = data;
+	}
+	frame->len++;
+	if(!(data & UART_FRAME_END_BIT)){
+		return;
+	}
+	if(frame->len > UART_FRAME_MAX_LEN || frame_rx->queue_len >= UART_FRAME_QUEUE_SIZE){
+		frame_rx->drop_count++;
+	}else{
+		frame_rx->queue[(frame_rx->queue_head + frame_rx->queue_len) % UART_FRAME_QUEUE_SIZE] = *frame;
+		frame_rx->queue_len++;
+	}
+	frame->len = 0;
+}
+
+/**
+ * Receive ring of the UART for the reader, NULL in frame mode.
+ * len, when given, is cut to the bytes before the padding of a DMA restart
+ */
+static RINGBUFFER_t * UART_get_rx(UART_id_t id, size_t * len){
+	UART_info_t * info = &uart_table[id];
+	uint32_t pad_start;
+	uint32_t restart;
+	uint32_t primask;
+	if(info->frame_rx || info->rx_buf == NULL){
+		return NULL;
+	}
+	if(info->ring_rx){
+		// Skip the overwritten bytes first, the tail may jump into the padding
+		RINGBUFFER_available(&info->rx);
+		primask = __get_PRIMASK();
+		__disable_irq();
+		pad_start = info->ring_rx->pad_start;
+		restart = info->ring_rx->restart;
+		__set_PRIMASK(primask);
+		if((int32_t)(restart - info->rx.tail) > 0){
+			if((int32_t)(info->rx.tail - pad_start) >= 0){
+				// At the padding, the bytes after it are the restarted DMA's
+				info->rx.tail = restart;
+			}else if(len && *len > pad_start - info->rx.tail){
+				*len = pad_start - info->rx.tail;
+			}
+		}
+	}
+	return &info->rx;
+}
+
 void HAL_UART_RxCpltCallback(UART_HandleTypeDef * huart){
-	if(huart->Instance == uart_table[UART_1].huart_p->Instance){
-		utils_buffer_push(uart_table[UART_1].buffer, &uart_table[UART_1].temp_data);
-		HAL_UART_Receive_IT(uart_table[UART_1].huart_p, &uart_table[UART_1].temp_data, 1);
-	}else if(huart->Instance == uart_table[UART_2].huart_p->Instance){
-		utils_buffer_push(uart_table[UART_2].buffer, &uart_table[UART_2].temp_data);
-		HAL_UART_Receive_IT(uart_table[UART_2].huart_p, &uart_table[UART_2].temp_data, 1);
-	}else if(huart->Instance == uart_table[UART_3].huart_p->Instance){
-		utils_buffer_push(uart_table[UART_3].buffer, &uart_table[UART_3].temp_data);
-		HAL_UART_Receive_IT(uart_table[UART_3].huart_p, &uart_table[UART_3].temp_data, 1);
-	}else if(huart->Instance == uart_table[UART_4].huart_p->Instance){
-		utils_buffer_push(uart_table[UART_4].buffer, &uart_table[UART_4].temp_data);
-		HAL_UART_Receive_IT(uart_table[UART_4].huart_p, &uart_table[UART_4].temp_data, 1);
+	for (int id = 0; id < UART_MAX; ++id) {
+		if(huart->Instance != uart_table[id].huart_p->Instance || uart_table[id].ring_rx || uart_table[id].frame_rx){
+			continue;
+		}
+		RINGBUFFER_push(&uart_table[id].rx, (uint8_t)uart_table[id].temp_data);
+		HAL_UART_Receive_IT(uart_table[id].huart_p, &uart_table[id].temp_data, 1);
+		if(uart_table[id].rx_cb) uart_table[id].rx_cb();
 	}
 }
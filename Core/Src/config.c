@@ -6,11 +6,26 @@
  */
 
 
+#include "stddef.h"
+#include "main.h"
 #include "config.h"
+#include "App/eventbus.h"
 #include "Device/eeprom.h"
+#include "Hal/power.h"
+#include "Lib/scheduler/scheduler.h"
 #include "Lib/utils/utils_logger.h"
 
 #define EEPROM_CONFIG_ADDRESS	0x0000
+// Counter journal: two base snapshots written in turn, then a ring of delta records.
+// One record is one EEPROM page so that each one is a single write, the region
+// ends with the EEPROM (AT24C32, 4KB)
+#define EEPROM_BASE_ADDRESS		0x0080
+#define EEPROM_JOURNAL_ADDRESS	0x0100
+#ifndef EEPROM_JOURNAL_END
+#define EEPROM_JOURNAL_END		0x1000
+#endif
+#define CONFIG_JOURNAL_SLOTS	((EEPROM_JOURNAL_END - EEPROM_JOURNAL_ADDRESS) / sizeof(CONFIG_record_t))
+#define CONFIG_BASE_SLOTS		2
 #define	CONFIG_DEFAULT {\
 							.version = VERSION, \
 							.device_id = DEVICE_ID_DEFAULT, \
@@ -20,18 +35,93 @@
 							.total_amount = 0,	\
 							.total_card = 0,	\
 							.total_card_by_day = 0,	\
-							.total_card_by_month = 0	\
+							.total_card_by_month = 0,	\
+							.report_format = CONFIG_REPORT_JSON	\
 						};
 
+enum {
+	CONFIG_AMOUNT,
+	CONFIG_TOTAL_AMOUNT,
+	CONFIG_TOTAL_CARD,
+	CONFIG_TOTAL_CARD_BY_DAY,
+	CONFIG_TOTAL_CARD_BY_MONTH,
+	CONFIG_COUNTER_MAX
+};
+
+// Base snapshot or delta record. Deltas wrap modulo 2^32 so a decrement or a reset
+// to 0 is a delta like the others
+typedef struct {
+	uint32_t seq;							// Base: last record included, record: its number
+	uint32_t value[CONFIG_COUNTER_MAX];		// Base: counters, record: deltas
+	uint8_t reserved[6];
+	uint16_t crc;
+}CONFIG_record_t;
+
 static CONFIG_t config = CONFIG_DEFAULT;
+// Copy of the EEPROM content, the bytes that differ from config are the ones to write
+static CONFIG_t config_saved;
+static uint32_t flush_task_id = NO_TASK_ID;
+// Write-back state. The PVD interrupt may flush in the middle of the main loop,
+// writing keeps it out of a flush already running
+static bool dirty = false;
+static uint32_t dirty_since;
+static volatile bool writing = false;
+// Writes queued and not yet acknowledged, the timings cover all of them
+static volatile uint32_t pending_writes = 0;
+static bool pending_wrote = false;
+static uint32_t pending_flush_start;
+static uint32_t pending_dirty_since;
+static CONFIG_stats_t stats = {0};
+// The counters are kept in the journal, not in the config area
+static const size_t counter_offset[CONFIG_COUNTER_MAX] = {
+		[CONFIG_AMOUNT] = offsetof(CONFIG_t, amount),
+		[CONFIG_TOTAL_AMOUNT] = offsetof(CONFIG_t, total_amount),
+		[CONFIG_TOTAL_CARD] = offsetof(CONFIG_t, total_card),
+		[CONFIG_TOTAL_CARD_BY_DAY] = offsetof(CONFIG_t, total_card_by_day),
+		[CONFIG_TOTAL_CARD_BY_MONTH] = offsetof(CONFIG_t, total_card_by_month),
+};
+static uint32_t journal_counters[CONFIG_COUNTER_MAX];	// Counters as of the last record written
+static uint32_t journal_seq = 0;						// Last record written
+static uint32_t base_seq = 0;							// Last record included in the base
+static uint8_t base_slot = 0;							// Base slot holding base_seq
+static bool rebase = false;								// Next write starts a new base from the counters
+// Failed journal writes, flagged from the I2C interrupt and repaired by the next write.
+// Replay stops at a missing record, so a lost one is written again or folded into a base
+static CONFIG_record_t last_record;						// Newest record, kept for one retry
+static bool last_record_retried = false;
+static volatile bool record_failed = false;
+static volatile uint32_t record_failed_seq;				// Oldest record that failed
+static volatile bool base_failed = false;
+static volatile uint8_t base_failed_slot;
 
 static bool CONFIG_set_default(CONFIG_t * config,  CONFIG_t *config_temp);
 static bool CONFIG_field_is_empty(uint8_t *data, size_t data_len);
+static void CONFIG_timeout_for_flush();
+static void CONFIG_power_fail();
+static void CONFIG_touch();
+static void CONFIG_write();
+static void CONFIG_write_done(bool success, void * arg);
+static void CONFIG_record_done(bool success, void * arg);
+static void CONFIG_base_done(bool success, void * arg);
+static void CONFIG_eeprom_write(uint16_t address, uint8_t * data, size_t data_len, EEPROM_cb cb, void * arg);
+static void CONFIG_journal_replay();
+static void CONFIG_journal_append();
+static void CONFIG_journal_compact();
+static void CONFIG_journal_repair();
+static uint16_t CONFIG_journal_address(uint32_t seq);
+static uint32_t * CONFIG_counter(CONFIG_t * _config, uint8_t counter);
+static bool CONFIG_record_read(uint16_t address, CONFIG_record_t * record);
+static void CONFIG_record_write(uint16_t address, CONFIG_record_t * record, EEPROM_cb cb, void * arg);
+static uint16_t CONFIG_crc16(uint8_t * data, size_t data_len);
 
 bool CONFIG_init(){
 	CONFIG_t temp;
 	EEPROM_read(EEPROM_CONFIG_ADDRESS, (uint8_t*)&temp, sizeof(CONFIG_t));
+	memcpy(&config_saved, &temp, sizeof(CONFIG_t));
 	CONFIG_set_default(&config, &temp);
+	CONFIG_journal_replay();
+	// Whatever is still in RAM when the supply drops goes out from the PVD interrupt
+	POWER_attach_fail(CONFIG_power_fail);
 	utils_log_info("CONFIG init done\r\n");
 	CONFIG_printf();
 }
@@ -40,12 +130,51 @@ CONFIG_t * CONFIG_get(){
 	return &config;
 }
 
+/**
+ * Take the new configuration, the changed bytes are written when the main loop
+ * is idle or after CONFIG_FLUSH_DELAY
+ */
 void CONFIG_set(CONFIG_t * _config){
-	memcpy(&config, _config, sizeof(CONFIG_t));
-	EEPROM_write(EEPROM_CONFIG_ADDRESS, (uint8_t*)&config, sizeof(CONFIG_t));
+	if(_config != &config){
+		memcpy(&config, _config, sizeof(CONFIG_t));
+	}
+	CONFIG_touch();
+	// The first change opens the window, later ones join it
+	if(!SCH_Is_Task_Alive(flush_task_id)){
+		flush_task_id = SCH_Add_Task_Priority(CONFIG_timeout_for_flush, CONFIG_FLUSH_DELAY, 0, SCH_PRIORITY_CRITICAL);
+		if(flush_task_id == NO_TASK_ID){
+			CONFIG_flush();
+		}
+	}
 	CONFIG_printf();
 }
 
+/**
+ * Write the changes now
+ */
+void CONFIG_flush(){
+	SCH_Delete_Task(flush_task_id);
+	flush_task_id = NO_TASK_ID;
+	CONFIG_write();
+}
+
+/**
+ * Called by the main loop before it sleeps, no event left means the changes of a sale are all made
+ */
+void CONFIG_idle(){
+	if(dirty && !EVENTBUS_is_pending()){
+		CONFIG_flush();
+	}
+}
+
+/**
+ * Flush and wait until the EEPROM holds everything, before a reset
+ */
+void CONFIG_sync(){
+	CONFIG_flush();
+	EEPROM_sync();
+}
+
 void CONFIG_reset_default(){
 	CONFIG_t default_config = CONFIG_DEFAULT;
 	CONFIG_set(&default_config);
@@ -66,7 +195,20 @@ void CONFIG_printf(){
 
 void CONFIG_clear(){
 	memset(&config, 0xFF , sizeof(CONFIG_t));
-	EEPROM_write(EEPROM_CONFIG_ADDRESS, &config, sizeof(CONFIG_t));
+	// The counters start again from a new base, as deltas the 0xFF would count up
+	for (int var = 0; var < CONFIG_COUNTER_MAX; ++var) {
+		*CONFIG_counter(&config, var) = 0;
+	}
+	rebase = true;
+	CONFIG_touch();
+	CONFIG_flush();
+}
+
+void CONFIG_get_stats(CONFIG_stats_t * stats_out){
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	memcpy(stats_out, &stats, sizeof(CONFIG_stats_t));
+	__set_PRIMASK(primask);
 }
 
 void CONFIG_test(){
@@ -111,6 +253,311 @@ static bool CONFIG_set_default(CONFIG_t * _config,  CONFIG_t *config_temp){
 	if(!CONFIG_field_is_empty((uint8_t*)(&config_temp->total_card_by_month), sizeof(config_temp->total_card_by_month))){
 		memcpy(&_config->total_card_by_month, &config_temp->total_card_by_month, sizeof(_config->total_card_by_month));
 	}
+	// Set report format
+	if(!CONFIG_field_is_empty((uint8_t*)(&config_temp->report_format), sizeof(config_temp->report_format))){
+		memcpy(&_config->report_format, &config_temp->report_format, sizeof(_config->report_format));
+	}
+}
+
+static void CONFIG_timeout_for_flush(){
+	flush_task_id = NO_TASK_ID;
+	CONFIG_flush();
+}
+
+/**
+ * PVD interrupt: queue what is still in RAM, the I2C interrupts send it while the
+ * supply decays. A flush already running covers it, the main loop finishes it.
+ * The flush task is left to the scheduler, it finds nothing to write
+ */
+static void CONFIG_power_fail(){
+	stats.power_fail_count++;
+	CONFIG_write();
+}
+
+static void CONFIG_touch(){
+	if(!dirty){
+		dirty = true;
+		dirty_since = HAL_GetTick();
+	}
+}
+
+/**
+ * One journal record for the counters, and for the other fields the changed
+ * bytes, one EEPROM write per page touched
+ */
+static void CONFIG_write(){
+	CONFIG_t image;
+	uint8_t * data = (uint8_t*)&image;
+	uint8_t * saved = (uint8_t*)&config_saved;
+	size_t page_end;
+	size_t first;
+	size_t last;
+	uint32_t primask;
+	if(writing){
+		return;
+	}
+	writing = true;
+	// Hold a reference so that the timings end with the last write of this flush
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if(pending_writes++ == 0){
+		pending_flush_start = HAL_GetTick();
+		pending_dirty_since = dirty ? dirty_since : pending_flush_start;
+	}
+	__set_PRIMASK(primask);
+	dirty = false;
+	CONFIG_journal_repair();
+	CONFIG_journal_append();
+	// Leave the counters of the config area as they are
+	memcpy(&image, &config, sizeof(CONFIG_t));
+	for (int var = 0; var < CONFIG_COUNTER_MAX; ++var) {
+		*CONFIG_counter(&image, var) = *CONFIG_counter(&config_saved, var);
+	}
+	for (size_t offset = 0; offset < sizeof(CONFIG_t); offset = page_end) {
+		page_end = offset + EEPROM_PAGE_SIZE - (EEPROM_CONFIG_ADDRESS + offset) % EEPROM_PAGE_SIZE;
+		if(page_end > sizeof(CONFIG_t)){
+			page_end = sizeof(CONFIG_t);
+		}
+		// Changed span in this page
+		for (first = offset; first < page_end && data[first] == saved[first]; ++first);
+		if(first == page_end){
+			continue;
+		}
+		for (last = page_end - 1; data[last] == saved[last]; --last);
+		CONFIG_eeprom_write(EEPROM_CONFIG_ADDRESS + first, &data[first], last - first + 1, CONFIG_write_done, NULL);
+		memcpy(&saved[first], &data[first], last - first + 1);
+	}
+	primask = __get_PRIMASK();
+	__disable_irq();
+	CONFIG_write_done(true, NULL);
+	__set_PRIMASK(primask);
+	writing = false;
+}
+
+/**
+ * Last page of a write acknowledged, called from the I2C interrupt
+ */
+static void CONFIG_write_done(bool success, void * arg){
+	uint32_t now = HAL_GetTick();
+	if(!success){
+		stats.write_error_count++;
+	}
+	if(--pending_writes > 0 || !pending_wrote){
+		return;
+	}
+	pending_wrote = false;
+	stats.flush_count++;
+	stats.flush_ms_last = now - pending_flush_start;
+	if(stats.flush_ms_last > stats.flush_ms_max){
+		stats.flush_ms_max = stats.flush_ms_last;
+	}
+	stats.dirty_ms_last = now - pending_dirty_since;
+	if(stats.dirty_ms_last > stats.dirty_ms_max){
+		stats.dirty_ms_max = stats.dirty_ms_last;
+	}
+}
+
+/**
+ * Journal record acknowledged, a failure leaves the config dirty so that the idle
+ * main loop repairs it
+ */
+static void CONFIG_record_done(bool success, void * arg){
+	if(!success && !record_failed){
+		record_failed = true;
+		record_failed_seq = (uint32_t)arg;
+		CONFIG_touch();
+	}
+	CONFIG_write_done(success, arg);
+}
+
+static void CONFIG_base_done(bool success, void * arg){
+	if(!success){
+		base_failed = true;
+		base_failed_slot = (uint8_t)(uint32_t)arg;
+		CONFIG_touch();
+	}
+	CONFIG_write_done(success, arg);
+}
+
+static void CONFIG_eeprom_write(uint16_t address, uint8_t * data, size_t data_len, EEPROM_cb cb, void * arg){
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	// Outside of a flush, the journal start at boot
+	if(pending_writes++ == 0){
+		pending_flush_start = HAL_GetTick();
+		pending_dirty_since = pending_flush_start;
+	}
+	pending_wrote = true;
+	__set_PRIMASK(primask);
+	EEPROM_write_cb(address, data, data_len, cb, arg);
+}
+
+/**
+ * Rebuild the counters from the newest base and the records following it
+ */
+static void CONFIG_journal_replay(){
+	CONFIG_record_t record;
+	bool found = false;
+	for (uint8_t slot = 0; slot < CONFIG_BASE_SLOTS; ++slot) {
+		if(!CONFIG_record_read(EEPROM_BASE_ADDRESS + slot * sizeof(CONFIG_record_t), &record)){
+			continue;
+		}
+		if(!found || (int32_t)(record.seq - base_seq) > 0){
+			found = true;
+			base_seq = record.seq;
+			base_slot = slot;
+			memcpy(journal_counters, record.value, sizeof(journal_counters));
+		}
+	}
+	if(!found){
+		// No journal yet, start it from the counters of the config area
+		for (int var = 0; var < CONFIG_COUNTER_MAX; ++var) {
+			journal_counters[var] = *CONFIG_counter(&config, var);
+		}
+		base_seq = 0;
+		base_slot = CONFIG_BASE_SLOTS - 1;
+		journal_seq = 0;
+		CONFIG_journal_compact();
+		return;
+	}
+	// Records are numbered without gap, the first missing or torn one ends the journal
+	journal_seq = base_seq;
+	while(journal_seq - base_seq < CONFIG_JOURNAL_SLOTS){
+		if(!CONFIG_record_read(CONFIG_journal_address(journal_seq + 1), &record)
+				|| record.seq != journal_seq + 1){
+			break;
+		}
+		for (int var = 0; var < CONFIG_COUNTER_MAX; ++var) {
+			journal_counters[var] += record.value[var];
+		}
+		journal_seq++;
+	}
+	for (int var = 0; var < CONFIG_COUNTER_MAX; ++var) {
+		*CONFIG_counter(&config, var) = journal_counters[var];
+	}
+	utils_log_info("CONFIG journal: base %d, %d records\r\n", base_seq, journal_seq - base_seq);
+}
+
+/**
+ * Write the counter changes since the last record as a new record
+ */
+static void CONFIG_journal_append(){
+	CONFIG_record_t record = {0};
+	bool changed = false;
+	if(rebase){
+		rebase = false;
+		for (int var = 0; var < CONFIG_COUNTER_MAX; ++var) {
+			journal_counters[var] = *CONFIG_counter(&config, var);
+		}
+		CONFIG_journal_compact();
+		return;
+	}
+	for (int var = 0; var < CONFIG_COUNTER_MAX; ++var) {
+		record.value[var] = *CONFIG_counter(&config, var) - journal_counters[var];
+		changed = changed || record.value[var] != 0;
+	}
+	if(!changed){
+		return;
+	}
+	if(journal_seq + 1 - base_seq > CONFIG_JOURNAL_SLOTS){
+		// The slot still holds the first record after the base, fold the journal into
+		// a new base first. Replay from the old base needs that record, so the new base
+		// has to be in the EEPROM before it is overwritten
+		CONFIG_journal_compact();
+		EEPROM_sync();
+		CONFIG_journal_repair();
+		EEPROM_sync();
+		if(base_failed){
+			// Keep the change in RAM, the next write tries again
+			CONFIG_touch();
+			return;
+		}
+	}
+	record.seq = journal_seq + 1;
+	CONFIG_record_write(CONFIG_journal_address(record.seq), &record, CONFIG_record_done, (void*)record.seq);
+	memcpy(&last_record, &record, sizeof(CONFIG_record_t));
+	last_record_retried = false;
+	journal_seq = record.seq;
+	for (int var = 0; var < CONFIG_COUNTER_MAX; ++var) {
+		journal_counters[var] += record.value[var];
+	}
+}
+
+/**
+ * Write the journaled counters as the new base in the other base slot,
+ * the current base stays valid if this write is cut
+ */
+static void CONFIG_journal_compact(){
+	CONFIG_record_t record = {0};
+	uint8_t slot = (base_slot + 1) % CONFIG_BASE_SLOTS;
+	record.seq = journal_seq;
+	memcpy(record.value, journal_counters, sizeof(record.value));
+	CONFIG_record_write(EEPROM_BASE_ADDRESS + slot * sizeof(CONFIG_record_t), &record, CONFIG_base_done, (void*)(uint32_t)slot);
+	base_seq = journal_seq;
+	base_slot = slot;
+}
+
+/**
+ * Write again what the EEPROM did not take. The newest record gets one retry, an older
+ * one or a second failure is covered by a new base. A failed base is written again in
+ * its slot, the other slot still holds the previous base
+ */
+static void CONFIG_journal_repair(){
+	bool _record_failed;
+	uint32_t seq;
+	bool _base_failed;
+	uint8_t slot;
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	_record_failed = record_failed;
+	seq = record_failed_seq;
+	_base_failed = base_failed;
+	slot = base_failed_slot;
+	record_failed = false;
+	base_failed = false;
+	__set_PRIMASK(primask);
+	if(_base_failed && slot == base_slot){
+		// Also covers a failed record
+		base_slot = (slot + 1) % CONFIG_BASE_SLOTS;
+		CONFIG_journal_compact();
+	}else if(_record_failed && (int32_t)(seq - base_seq) > 0){
+		if(seq == journal_seq && !last_record_retried){
+			last_record_retried = true;
+			CONFIG_record_write(CONFIG_journal_address(seq), &last_record, CONFIG_record_done, (void*)seq);
+		}else{
+			CONFIG_journal_compact();
+		}
+	}
+}
+
+static uint16_t CONFIG_journal_address(uint32_t seq){
+	return EEPROM_JOURNAL_ADDRESS + (seq % CONFIG_JOURNAL_SLOTS) * sizeof(CONFIG_record_t);
+}
+
+static uint32_t * CONFIG_counter(CONFIG_t * _config, uint8_t counter){
+	return (uint32_t *)((uint8_t *)_config + counter_offset[counter]);
+}
+
+static bool CONFIG_record_read(uint16_t address, CONFIG_record_t * record){
+	EEPROM_read(address, (uint8_t*)record, sizeof(CONFIG_record_t));
+	return record->crc == CONFIG_crc16((uint8_t*)record, offsetof(CONFIG_record_t, crc));
+}
+
+static void CONFIG_record_write(uint16_t address, CONFIG_record_t * record, EEPROM_cb cb, void * arg){
+	record->crc = CONFIG_crc16((uint8_t*)record, offsetof(CONFIG_record_t, crc));
+	CONFIG_eeprom_write(address, (uint8_t*)record, sizeof(CONFIG_record_t), cb, arg);
+}
+
+// CRC-16/CCITT-FALSE
+static uint16_t CONFIG_crc16(uint8_t * data, size_t data_len){
+	uint16_t crc = 0xFFFF;
+	for (size_t var = 0; var < data_len; ++var) {
+		crc ^= (uint16_t)data[var] << 8;
+		for (int bit = 0; bit < 8; ++bit) {
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+		}
+	}
+	return crc;
 }
 
 static bool CONFIG_field_is_empty(uint8_t *data, size_t data_len){
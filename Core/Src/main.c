@@ -26,6 +26,8 @@
 #include "Hal/timer.h"
 #include "Hal/i2c.h"
 #include "Hal/uart.h"
+#include "Hal/power.h"
+#include "config.h"
 #include "Device/eeprom.h"
 #include "Device/keypad.h"
 #include "Device/billacceptor.h"
@@ -39,6 +41,7 @@
 #include "DeviceManager/keypadmanager.h"
 #include "App/commandhandler.h"
 #include "App/schedulerport.h"
+#include "App/profiler.h"
 #include "App/statusreporter.h"
 #include "App/statemachine.h"
 
@@ -90,13 +93,15 @@ int main(void)
   UART_init();
   I2C_init();
   WATCHDOG_init();
+  POWER_init();
   // Init
+  EEPROM_init();	// Before CONFIG_init, which reads the EEPROM
   CONFIG_init();
   SCHEDULERPORT_init();
+  PROFILER_init();
 
   // Device Init
   BILLACCEPTOR_init();
-  EEPROM_init();
   TCD_init();
   KEYPAD_init();
   LCD_init();
@@ -111,7 +116,6 @@ int main(void)
   // App Init
   MQTT_init();
   COMMANDHANDLER_init();
-  SCHEDULERPORT_init();
   STATUSREPORTER_init();
   STATEMACHINE_init();
   /* USER CODE END Init */
@@ -132,6 +136,8 @@ int main(void)
   {
 	  WATCHDOG_refresh();
 	  STATEMACHINE_run();
+	  CONFIG_idle();
+	  SCHEDULERPORT_sleep();
     /* USER CODE END WHILE */
 
     /* USER CODE BEGIN 3 */
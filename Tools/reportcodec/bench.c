@@ -0,0 +1,123 @@
+/*
+ * bench.c
+ *
+ * Size and encoding time of the reports, JSON as built by statusreporter.c against
+ * the binary frames of reportcodec.c. Runs on the host:
+ *
+ *   gcc -O2 -I../../Core/Inc -o bench bench.c ../../Core/Src/App/reportcodec.c && ./bench
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: agent
+ */
+
+#include "stdio.h"
+#include "string.h"
+#include "time.h"
+#include "App/reportcodec.h"
+
+#define PAYLOAD_MAX_LEN		256
+#define ROUNDS				1000000
+
+static char payload[PAYLOAD_MAX_LEN];
+static volatile size_t sink;
+
+static void json_status(){
+	snprintf(payload, PAYLOAD_MAX_LEN,
+			"{\"v\":\"%s\",\"con_type\":\"%d\",\"pwd\":\"%s\",\"cp\":%d,\"amt\":%d,\"to_amt\":%d,"
+			"\"to_ca\":%d,\"to_ca_d\":%d,\"to_ca_m\":%d,\"tcd_1\":[%d,%d,%d],\"tcd_2\":[%d,%d,%d],"
+			"\"bill\": %d,\"ob\":[%d,%d,%d,%d],\"mp\":[%d,%d,%d]}",
+			"1.0.0", 1, "123", 10000, 20000, 1250000, 125, 12, 87, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 3, 1, 3, 0);
+}
+
+static void binary_status(){
+	REPORTCODEC_t codec;
+	uint32_t tcd_1[] = {0, 0, 1};
+	uint32_t tcd_2[] = {0, 0, 0};
+	uint32_t ob[] = {0, 0, 0, 3};
+	uint32_t mp[] = {1, 3, 0};
+	REPORTCODEC_begin(&codec, REPORTCODEC_STATUS);
+	REPORTCODEC_string(&codec, REPORTCODEC_STATUS_V, "1.0.0", 8);
+	REPORTCODEC_uint(&codec, REPORTCODEC_STATUS_CON_TYPE, 1);
+	REPORTCODEC_string(&codec, REPORTCODEC_STATUS_PWD, "123", 10);
+	REPORTCODEC_uint(&codec, REPORTCODEC_STATUS_CP, 10000);
+	REPORTCODEC_uint(&codec, REPORTCODEC_STATUS_AMT, 20000);
+	REPORTCODEC_uint(&codec, REPORTCODEC_STATUS_TO_AMT, 1250000);
+	REPORTCODEC_uint(&codec, REPORTCODEC_STATUS_TO_CA, 125);
+	REPORTCODEC_uint(&codec, REPORTCODEC_STATUS_TO_CA_D, 12);
+	REPORTCODEC_uint(&codec, REPORTCODEC_STATUS_TO_CA_M, 87);
+	REPORTCODEC_array(&codec, REPORTCODEC_STATUS_TCD_1, tcd_1, 3);
+	REPORTCODEC_array(&codec, REPORTCODEC_STATUS_TCD_2, tcd_2, 3);
+	REPORTCODEC_uint(&codec, REPORTCODEC_STATUS_BILL, 1);
+	REPORTCODEC_array(&codec, REPORTCODEC_STATUS_OB, ob, 4);
+	REPORTCODEC_array(&codec, REPORTCODEC_STATUS_MP, mp, 3);
+	REPORTCODEC_end(&codec, payload, PAYLOAD_MAX_LEN);
+}
+
+static void json_bill_accepted(){
+	snprintf(payload, PAYLOAD_MAX_LEN, "{\"value\":%d}", 20000);
+}
+
+static void binary_bill_accepted(){
+	REPORTCODEC_t codec;
+	REPORTCODEC_begin(&codec, REPORTCODEC_BILL_ACCEPTED);
+	REPORTCODEC_uint(&codec, REPORTCODEC_BILL_ACCEPTED_VALUE, 20000);
+	REPORTCODEC_end(&codec, payload, PAYLOAD_MAX_LEN);
+}
+
+static void json_dispense(){
+	snprintf(payload, PAYLOAD_MAX_LEN, "{\"dir\":%d}", 1);
+}
+
+static void binary_dispense(){
+	REPORTCODEC_t codec;
+	REPORTCODEC_begin(&codec, REPORTCODEC_DISPENSE);
+	REPORTCODEC_uint(&codec, REPORTCODEC_DISPENSE_DIR, 1);
+	REPORTCODEC_end(&codec, payload, PAYLOAD_MAX_LEN);
+}
+
+static void json_transaction(){
+	snprintf(payload, PAYLOAD_MAX_LEN, "{\"price\":%d,\"quantity\":%d}", 10000, 2);
+}
+
+static void binary_transaction(){
+	REPORTCODEC_t codec;
+	REPORTCODEC_begin(&codec, REPORTCODEC_TRANSACTION);
+	REPORTCODEC_uint(&codec, REPORTCODEC_TRANSACTION_PRICE, 10000);
+	REPORTCODEC_uint(&codec, REPORTCODEC_TRANSACTION_QUANTITY, 2);
+	REPORTCODEC_end(&codec, payload, PAYLOAD_MAX_LEN);
+}
+
+static double bench(void (*encode)(), size_t * len){
+	struct timespec start, end;
+	encode();
+	*len = strlen(payload);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int var = 0; var < ROUNDS; ++var) {
+		encode();
+		sink += payload[0];
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / ROUNDS;
+}
+
+int main(){
+	struct {
+		const char * name;
+		void (*json)();
+		void (*binary)();
+	} reports[] = {
+		{"status", json_status, binary_status},
+		{"bill_accepted", json_bill_accepted, binary_bill_accepted},
+		{"dispense", json_dispense, binary_dispense},
+		{"transaction", json_transaction, binary_transaction},
+	};
+	size_t json_len, binary_len;
+	double json_ns, binary_ns;
+	printf("%-14s %10s %10s %12s %12s\n", "report", "json B", "binary B", "json ns", "binary ns");
+	for (size_t var = 0; var < sizeof(reports) / sizeof(reports[0]); ++var) {
+		json_ns = bench(reports[var].json, &json_len);
+		binary_ns = bench(reports[var].binary, &binary_len);
+		printf("%-14s %10zu %10zu %12.1f %12.1f\n", reports[var].name, json_len, binary_len, json_ns, binary_ns);
+	}
+	return 0;
+}
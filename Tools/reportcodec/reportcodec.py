@@ -0,0 +1,114 @@
+"""Decoder for the card-vendor reports, JSON or binary (Core/Inc/App/reportcodec.h).
+
+    import reportcodec
+    reportcodec.decode(payload)          # one report -> dict with the JSON keys
+    reportcodec.decode_batch(payload)    # rp/batch -> list of (report, dict)
+
+    python3 reportcodec.py <payload>
+"""
+
+import base64
+import json
+import sys
+
+VERSION = 1
+
+UINT, STRING, ARRAY = 0, 1, 2
+
+REPORTS = {
+    1: ("status", {
+        1: "v", 2: "con_type", 3: "pwd", 4: "cp", 5: "amt", 6: "to_amt", 7: "to_ca",
+        8: "to_ca_d", 9: "to_ca_m", 10: "tcd_1", 11: "tcd_2", 12: "bill", 13: "ob", 14: "mp",
+    }),
+    2: ("bill_accepted", {1: "value"}),
+    3: ("dispense", {1: "dir"}),
+    4: ("transaction", {1: "price", 2: "quantity"}),
+}
+REPORTS[5] = ("status_delta", REPORTS[1][1])
+
+# Numbers in the frame that the JSON payload quotes, given back as in the JSON
+JSON_STRINGS = {"con_type"}
+
+
+class DecodeError(ValueError):
+    pass
+
+
+def is_binary(payload):
+    payload = payload.lstrip()
+    return not payload.startswith(("{", "["))
+
+
+def _varint(data, pos):
+    value = shift = 0
+    while True:
+        if pos >= len(data):
+            raise DecodeError("truncated varint")
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+
+def decode_frame(frame):
+    """Binary frame (bytes) -> (report, dict)"""
+    if not frame:
+        raise DecodeError("empty frame")
+    if frame[0] >> 4 != VERSION:
+        raise DecodeError("version %d" % (frame[0] >> 4))
+    report, names = REPORTS.get(frame[0] & 0x0F, (None, None))
+    if report is None:
+        raise DecodeError("report %d" % (frame[0] & 0x0F))
+    fields = {}
+    pos = 1
+    while pos < len(frame):
+        tag = frame[pos]
+        pos += 1
+        wire, field = tag >> 6, tag & 0x3F
+        if wire == UINT:
+            value, pos = _varint(frame, pos)
+        elif wire == STRING:
+            length, pos = _varint(frame, pos)
+            if pos + length > len(frame):
+                raise DecodeError("truncated string")
+            value = frame[pos:pos + length].decode("ascii", "replace")
+            pos += length
+        elif wire == ARRAY:
+            count, pos = _varint(frame, pos)
+            value = []
+            for _ in range(count):
+                item, pos = _varint(frame, pos)
+                value.append(item)
+        else:
+            raise DecodeError("wire type %d" % wire)
+        # Unknown fields are kept by id, newer firmware may add some
+        name = names.get(field, field)
+        if name in JSON_STRINGS:
+            value = str(value)
+        fields[name] = value
+    return report, fields
+
+
+def decode(payload):
+    """One report payload, JSON or base64 frame -> dict"""
+    if not is_binary(payload):
+        return json.loads(payload)
+    return decode_frame(base64.b64decode(payload.strip(), validate=True))[1]
+
+
+def decode_batch(payload):
+    """rp/batch payload -> list of (report, dict)"""
+    if not is_binary(payload):
+        return [(entry["rp"], entry["d"]) for entry in json.loads(payload)]
+    return [decode_frame(base64.b64decode(frame, validate=True))
+            for frame in payload.strip().split(",") if frame]
+
+
+if __name__ == "__main__":
+    for arg in sys.argv[1:]:
+        if "," in arg and is_binary(arg):
+            print(json.dumps(decode_batch(arg)))
+        else:
+            print(json.dumps(decode(arg)))